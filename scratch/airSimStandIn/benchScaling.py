@@ -0,0 +1,119 @@
+#!/usr/bin/env python3
+# Scaling benchmark of the co-simulation loop, nsAirSim against airSimStandIn.
+#
+# Every combination of the swept parameters is run once: the stand-in is
+# started first, then nsAirSim with --benchOutput, and the JSON summary of
+# every run is collected into a single file.
+#
+# Build first, then run from the ns-3 root, e.g.
+#   ./waf build
+#   python3 scratch/airSimStandIn/benchScaling.py --uavs 2,10,50 --net lte,wifi -o bench.json
+
+from __future__ import print_function
+import argparse
+import itertools
+import json
+import os
+import subprocess
+import sys
+import tempfile
+import time
+
+
+def csv(cast):
+    return lambda s: [cast(x) for x in s.split(',') if x]
+
+
+def parse_args():
+    parser = argparse.ArgumentParser(description='Scaling benchmark of nsAirSim against airSimStandIn')
+    parser.add_argument('--ns3Dir', default='.', help='ns-3 root, where build/ lives')
+    parser.add_argument('--uavs', type=csv(int), default=[2, 10, 50], help='numbers of UAVs')
+    parser.add_argument('--congs', type=csv(int), default=[0], help='numbers of congestion nodes')
+    parser.add_argument('--msgSizes', type=csv(int), default=[256], help='payload bytes')
+    parser.add_argument('--msgsPerTick', type=csv(int), default=[1], help='messages per UAV and tick, in each direction')
+    parser.add_argument('--granularities', type=csv(float), default=[0.01], help='updateGranularity values')
+    parser.add_argument('--net', type=csv(str), default=['lte'], help='lte and/or wifi')
+    parser.add_argument('--ticks', type=int, default=500, help='turns per run')
+    parser.add_argument('--timeout', type=float, default=600, help='seconds before a run is killed')
+    parser.add_argument('--nsArgs', default='', help='extra arguments for nsAirSim')
+    parser.add_argument('-o', '--output', default='-', help='JSON file, - for stdout')
+    return parser.parse_args()
+
+
+def program(ns3Dir, name):
+    path = os.path.join(ns3Dir, 'build', 'scratch', name, name)
+    if not os.path.exists(path):
+        sys.exit('%s not found, build with ./waf first' % path)
+    return path
+
+
+def run_once(args, env, point):
+    numOfUav, numOfCong, msgSize, msgsPerTick, granularity, net = point
+    standIn = [program(args.ns3Dir, 'airSimStandIn'),
+               '--numOfUav=%d' % numOfUav,
+               '--numOfCong=%d' % numOfCong,
+               '--msgSize=%d' % msgSize,
+               '--uavMsgsPerTick=%d' % msgsPerTick,
+               '--gcsMsgsPerTick=%d' % msgsPerTick,
+               '--updateGranularity=%g' % granularity,
+               '--useWifi=%d' % (net == 'wifi'),
+               '--ticks=%d' % args.ticks]
+    fd, benchOutput = tempfile.mkstemp(suffix='.json')
+    os.close(fd)
+    ns = [program(args.ns3Dir, 'nsAirSim'), '--benchOutput=' + benchOutput] + args.nsArgs.split()
+
+    result = {'msgSize': msgSize, 'msgsPerTick': msgsPerTick, 'net': net}
+    standInProc = subprocess.Popen(standIn, env=env, stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL)
+    try:
+        start = time.time()
+        nsProc = subprocess.run(ns, env=env, stdout=subprocess.DEVNULL, stderr=subprocess.PIPE, timeout=args.timeout)
+        standInProc.wait(timeout=max(1, args.timeout - (time.time() - start)))
+        if nsProc.returncode != 0:
+            result['error'] = 'nsAirSim exited with %d: %s' % (nsProc.returncode, nsProc.stderr.decode(errors='replace')[-500:])
+        else:
+            with open(benchOutput) as f:
+                result.update(json.load(f))
+    except subprocess.TimeoutExpired:
+        result['error'] = 'timeout after %g s' % args.timeout
+    finally:
+        if standInProc.poll() is None:
+            standInProc.kill()
+            standInProc.wait()
+        os.remove(benchOutput)
+    # what was asked for, nsAirSim reports what it ran with
+    result.setdefault('numOfUav', numOfUav)
+    result.setdefault('numOfCong', numOfCong)
+    result.setdefault('updateGranularity', granularity)
+    return result
+
+
+def main():
+    args = parse_args()
+    env = dict(os.environ)
+    lib = os.path.abspath(os.path.join(args.ns3Dir, 'build', 'lib'))
+    env['LD_LIBRARY_PATH'] = lib + os.pathsep + env.get('LD_LIBRARY_PATH', '')
+
+    points = list(itertools.product(args.uavs, args.congs, args.msgSizes, args.msgsPerTick, args.granularities, args.net))
+    results = []
+    for i, point in enumerate(points):
+        print('[%d/%d] uavs=%d congs=%d msgSize=%d msgsPerTick=%d granularity=%g net=%s' % ((i + 1, len(points)) + point), file=sys.stderr)
+        result = run_once(args, env, point)
+        if 'error' in result:
+            print('  ' + result['error'], file=sys.stderr)
+        else:
+            print('  turn mean=%.3f ms p99=%.3f ms, sim/wall=%.2f, peak RSS=%d kB' % (
+                result['turnWallMean'] * 1e3, result['turnWallP99'] * 1e3, result['simToWallRatio'], result['peakRssKb']), file=sys.stderr)
+        results.append(result)
+
+    out = {'ticks': args.ticks, 'runs': results}
+    if args.output == '-':
+        json.dump(out, sys.stdout, indent=2)
+        print()
+    else:
+        with open(args.output, 'w') as f:
+            json.dump(out, f, indent=2)
+    return 0 if all('error' not in r for r in results) else 1
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,472 @@
+// std includes
+#include <vector>
+#include <string>
+#include <sstream>
+#include <fstream>
+#include <atomic>
+#include <cmath>
+#include <unordered_map>
+#include <map>
+#include <algorithm>
+#include <cstring>
+#include <chrono>
+#include <thread>
+// ns3 includes
+#include "ns3/core-module.h"
+// AirSim includes
+#include "common/common_utils/StrictMode.hpp"
+STRICT_MODE_OFF
+#ifndef RPCLIB_MSGPACK
+#define RPCLIB_MSGPACK clmdep_msgpack
+#endif // !RPCLIB_MSGPACK
+#include "rpc/server.h"
+STRICT_MODE_ON
+#include "api/RpcLibAdapatorsBase.hpp"
+#include "physics/Kinematics.hpp"
+// zmq includes
+#include <zmq.hpp>
+// custom includes
+#include "../nsAirSim/wireFormat.h"
+
+// Headless stand-in for AirSim's side of the co-simulation protocol, so that
+// nsAirSim can be run and load-tested without Unreal:
+// - control channel: NetConfig blob, then one end of turn per tick granted and a bye frame
+// - RPC: simGetGroundTruthKinematics answered from scripted trajectories
+// - application traffic: synthetic messages on the UAV and GCS muxes
+//
+// Start the stand-in first, then nsAirSim, e.g.
+//   ./waf --run "airSimStandIn --numOfUav=100 --ticks=1000"
+//   ./waf --run nsAirSim
+
+using namespace std;
+using namespace ns3;
+
+NS_LOG_COMPONENT_DEFINE ("AIRSIM_STANDIN");
+
+// mirror of the ports in nsAirSim/AirSimSync.h, seen from AirSim's side
+#define NS2AIRSIM_UAV_PORT (5000)
+#define AIRSIM2NS_UAV_PORT (6000)
+#define NS2AIRSIM_GCS_PORT (4999)
+#define AIRSIM2NS_GCS_PORT (4998)
+#define NS2AIRSIM_CTRL_PORT (8000)
+#define AIRSIM2NS_CTRL_PORT (8001)
+
+#define STANDIN_RPC_PORT (41451) // AirLib's default RpcLibPort
+#define STANDIN_RPC_THREADS (4)
+// what confirmConnection() checks against
+#define STANDIN_SERVER_VERSION (1)
+#define STANDIN_MIN_CLIENT_VERSION (1)
+
+// every UAV flies its own circle, centers spaced along x
+struct Trajectory
+{
+  double radius = 20.0; // m, 0 hovers
+  double speed = 5.0; // m/s
+  double altitude = 10.0; // m above ground
+  double spacing = 5.0; // m between circle centers
+
+  msr::airlib::Kinematics::State at(uint16_t id, double t) const
+  {
+    msr::airlib::Kinematics::State state = msr::airlib::Kinematics::State::zero();
+    double cx = spacing * id;
+    double phase = 0.5 * id;
+
+    if(radius <= 0.0){
+      state.pose.position = msr::airlib::Vector3r(cx, 0, -altitude);
+      return state;
+    }
+    double w = speed / radius;
+    double a = w * t + phase;
+    // NED, z points down
+    state.pose.position = msr::airlib::Vector3r(cx + radius * cos(a), radius * sin(a), -altitude);
+    state.twist.linear = msr::airlib::Vector3r(-speed * sin(a), speed * cos(a), 0);
+    state.accelerations.linear = msr::airlib::Vector3r(-speed * w * cos(a), -speed * w * sin(a), 0);
+    return state;
+  }
+};
+
+// one ZmqMux endpoint pair, seen from AirSim's side
+struct MuxPeer
+{
+  zmq::socket_t send; // DEALER, ns' ROUTER connects to it
+  zmq::socket_t recv; // PULL, connects to ns' PUSH
+  uint32_t seq = 0;
+
+  uint64_t sent = 0;
+  uint64_t dropped = 0; // send would have blocked
+  uint64_t acked = 0;
+  uint64_t failed = 0; // acknowledged with a negative Send() result
+  uint64_t received = 0;
+  uint64_t receivedBytes = 0;
+
+  MuxPeer(zmq::context_t &context, int sendPort, int recvPort)
+  {
+    send = zmq::socket_t(context, ZMQ_DEALER);
+    send.bind("tcp://*:" + to_string(sendPort));
+    recv = zmq::socket_t(context, ZMQ_PULL);
+    recv.connect("tcp://localhost:" + to_string(recvPort));
+  }
+
+  // false if the message was dropped, offsetNs is the send time into the tick
+  bool sendMessage(uint16_t vehicleId, const std::string &payload, int64_t offsetNs = 0, uint8_t msgClass = 0)
+  {
+    MsgHeader hdr;
+    hdr.vehicleId = vehicleId;
+    hdr.seq = seq++;
+    hdr.timeNs = offsetNs;
+    hdr.msgClass = msgClass;
+    zmq::message_t head(&hdr, sizeof(hdr));
+    zmq::message_t body(payload.data(), payload.size());
+
+    if(!send.send(head, zmq::send_flags::sndmore | zmq::send_flags::dontwait)){
+      dropped++;
+      return false;
+    }
+    send.send(body, zmq::send_flags::none);
+    sent++;
+    return true;
+  }
+
+  // acknowledgements, | MsgHeader | int32 | per message or | AckHeader | entries | batched
+  void drainAcks(void)
+  {
+    zmq::message_t head, body;
+
+    while(send.recv(head, zmq::recv_flags::dontwait)){
+      if(head.more()){
+        send.recv(body, zmq::recv_flags::none);
+        int32_t result;
+        if(body.size() >= sizeof(result)){
+          memcpy(&result, body.data(), sizeof(result));
+          countAck(result);
+        }
+        continue;
+      }
+      AckHeader ack;
+      if(head.size() < sizeof(ack)){
+        continue;
+      }
+      memcpy(&ack, head.data(), sizeof(ack));
+      const uint8_t *entries = static_cast<const uint8_t*>(head.data()) + sizeof(ack);
+      for(std::size_t i = 0; i < ack.count && sizeof(ack) + (i + 1) * sizeof(AckEntry) <= head.size(); i++){
+        AckEntry entry;
+        memcpy(&entry, entries + i * sizeof(entry), sizeof(entry));
+        countAck(entry.result);
+      }
+    }
+  }
+
+  // messages ns delivered over the simulated network
+  void drainReceived(void)
+  {
+    zmq::message_t head, body;
+
+    while(recv.recv(head, zmq::recv_flags::dontwait)){
+      if(!head.more()){
+        continue;
+      }
+      recv.recv(body, zmq::recv_flags::none);
+      received++;
+      receivedBytes += body.size();
+    }
+  }
+
+  void countAck(int32_t result)
+  {
+    acked++;
+    if(result < 0){
+      failed++;
+    }
+  }
+};
+
+// the text blob parsed by operator>>(istream&, NetConfig&) in nsAirSim
+static std::string netConfigBlob(float updateGranularity, const std::vector<std::string> &uavsName,
+  int numOfCong, float congRate, int useWifi, int usePoseStream, int asyncAck, int lookahead, float maxGranularity, int netState, uint32_t udpClasses)
+{
+  std::ostringstream os;
+
+  os << updateGranularity << " ";
+  // segmentSize numOfCong congRate congX congY congRho
+  os << 1448 << " " << numOfCong << " " << congRate << " " << 0 << " " << 0 << " " << 50 << " ";
+  os << uavsName.size() << " ";
+  for(auto &it:uavsName){
+    os << it << " ";
+  }
+  // a single eNB/AP at the origin
+  os << 1 << " " << 0 << " " << 0 << " " << 0 << " ";
+  // nRbs TcpSndBufSize TcpRcvBufSize CqiTimerThreshold LteTxPower p2pDataRate p2pMtu p2pDelay
+  os << 25 << " " << 429496729 << " " << 429496729 << " " << 10 << " " << 30 << " " << "10Gb/s" << " " << 1500 << " " << 0.001 << " ";
+  os << useWifi << " ";
+  // main gcs uav cong sync logs
+  os << "0 0 0 0 0 ";
+  os << usePoseStream << " " << asyncAck << " " << lookahead << " " << maxGranularity << " " << netState << " " << udpClasses;
+  return os.str();
+}
+// same config as a versioned msgpack map, fields left out take ns' defaults
+static std::string netConfigMsgpack(float updateGranularity, const std::vector<std::string> &uavsName,
+  int numOfCong, float congRate, int useWifi, int usePoseStream, int asyncAck, int lookahead, float maxGranularity, int netState, uint32_t udpClasses)
+{
+  clmdep_msgpack::sbuffer buffer;
+  clmdep_msgpack::packer<clmdep_msgpack::sbuffer> pk(&buffer);
+  std::vector< std::vector<float> > initEnbApPos(1, std::vector<float>(3, 0.0f));
+
+  pk.pack_map(13);
+  pk.pack(std::string("version")); pk.pack(NET_CONFIG_VERSION);
+  pk.pack(std::string("updateGranularity")); pk.pack(updateGranularity);
+  pk.pack(std::string("numOfCong")); pk.pack(numOfCong);
+  pk.pack(std::string("congRate")); pk.pack(congRate);
+  pk.pack(std::string("uavsName")); pk.pack(uavsName);
+  pk.pack(std::string("initEnbApPos")); pk.pack(initEnbApPos);
+  pk.pack(std::string("useWifi")); pk.pack(useWifi);
+  pk.pack(std::string("usePoseStream")); pk.pack(usePoseStream);
+  pk.pack(std::string("asyncAck")); pk.pack(asyncAck);
+  pk.pack(std::string("lookahead")); pk.pack(lookahead);
+  pk.pack(std::string("maxGranularity")); pk.pack(maxGranularity);
+  pk.pack(std::string("netState")); pk.pack(netState);
+  pk.pack(std::string("udpClasses")); pk.pack(udpClasses);
+  return std::string(buffer.data(), buffer.size());
+}
+
+// | PoseFrameHeader | count * (PoseEntry PoseAccel) |
+static zmq::message_t poseFrame(uint32_t tick, const Trajectory &trajectory, std::size_t numOfUav, double t)
+{
+  PoseFrameHeader hdr;
+  hdr.type = CTRL_FRAME_POSE;
+  hdr.flags = POSE_FLAG_ACCEL;
+  hdr.count = numOfUav;
+  hdr.tick = tick;
+  zmq::message_t frame(sizeof(hdr) + numOfUav * poseEntrySize(hdr.flags));
+  uint8_t *p = static_cast<uint8_t*>(frame.data());
+
+  memcpy(p, &hdr, sizeof(hdr));
+  p += sizeof(hdr);
+  for(std::size_t i = 0; i < numOfUav; i++){
+    msr::airlib::Kinematics::State state = trajectory.at(i, t);
+    PoseEntry entry;
+    PoseAccel accel;
+    entry.vehicleId = i;
+    for(int k = 0; k < 3; k++){
+      entry.pos[k] = state.pose.position[k];
+      entry.vel[k] = state.twist.linear[k];
+      accel.acc[k] = state.accelerations.linear[k];
+    }
+    memcpy(p, &entry, sizeof(entry));
+    p += sizeof(entry);
+    memcpy(p, &accel, sizeof(accel));
+    p += sizeof(accel);
+  }
+  return frame;
+}
+
+int main(int argc, char *argv[])
+{
+  // local vars
+  zmq::context_t context(1);
+  int numOfUav = 2;
+  int numOfCong = 0;
+  float congRate = 0.1;
+  float updateGranularity = 0.01;
+  int useWifi = 0;
+  int usePoseStream = 0;
+  int asyncAck = 0;
+  int lookahead = 0;
+  float maxGranularity = 0;
+  int netState = 0;
+  uint32_t udpClasses = 0;
+  uint32_t msgClass = 0;
+  uint32_t trafficEvery = 1;
+  bool realtime = false;
+  bool spreadSends = false;
+  bool msgpackConfig = false;
+  std::string netConfigOut;
+  uint32_t ticks = 1000;
+  uint32_t msgSize = 256;
+  uint32_t uavMsgsPerTick = 1; // per UAV, UAV -> GCS
+  uint32_t gcsMsgsPerTick = 1; // per UAV, GCS -> UAV
+  Trajectory trajectory;
+
+  CommandLine cmd (__FILE__);
+  cmd.AddValue ("numOfUav", "Number of virtual UAVs", numOfUav);
+  cmd.AddValue ("numOfCong", "Number of congestion nodes", numOfCong);
+  cmd.AddValue ("congRate", "Congestion rate sent in NetConfig", congRate);
+  cmd.AddValue ("updateGranularity", "Simulated seconds per tick", updateGranularity);
+  cmd.AddValue ("useWifi", "1 for Wifi, 0 for LTE", useWifi);
+  cmd.AddValue ("usePoseStream", "End every turn with a pose frame instead of serving poses by RPC only", usePoseStream);
+  cmd.AddValue ("asyncAck", "Ask ns for batched acknowledgements", asyncAck);
+  cmd.AddValue ("lookahead", "Ticks the stand-in may run ahead of ns, 0 is strict lockstep", lookahead);
+  cmd.AddValue ("maxGranularity", "Longest tick ns may suggest while the network is idle, 0 keeps ticks fixed", maxGranularity);
+  cmd.AddValue ("realtime", "Pace ticks by the wall clock and never wait for grants, for ns --realtime", realtime);
+  cmd.AddValue ("msgpackConfig", "Send NetConfig as msgpack instead of the text blob", msgpackConfig);
+  cmd.AddValue ("netConfigOut", "Write NetConfig to this file for ns --netConfig instead of sending it", netConfigOut);
+  cmd.AddValue ("spreadSends", "Spread the messages of a tick evenly over it instead of sending them all at its start", spreadSends);
+  cmd.AddValue ("netState", "Ask ns for a link metrics frame per tick", netState);
+  cmd.AddValue ("udpClasses", "Message classes ns sends over UDP, bit n for class n", udpClasses);
+  cmd.AddValue ("msgClass", "Message class of every synthetic message", msgClass);
+  cmd.AddValue ("trafficEvery", "Send the synthetic messages only every this many ticks", trafficEvery);
+  cmd.AddValue ("ticks", "Number of turns before saying bye", ticks);
+  cmd.AddValue ("msgSize", "Payload bytes of every synthetic message", msgSize);
+  cmd.AddValue ("uavMsgsPerTick", "Messages every UAV sends to the GCS per tick", uavMsgsPerTick);
+  cmd.AddValue ("gcsMsgsPerTick", "Messages the GCS sends to every UAV per tick", gcsMsgsPerTick);
+  cmd.AddValue ("radius", "Radius of the circle every UAV flies, 0 hovers", trajectory.radius);
+  cmd.AddValue ("speed", "Ground speed on the circle", trajectory.speed);
+  cmd.Parse (argc, argv);
+
+  std::vector<std::string> uavsName(numOfUav);
+  std::unordered_map<std::string, uint16_t> uavsId;
+  for(int i = 0; i < numOfUav; i++){
+    uavsName[i] = "Drone" + to_string(i + 1);
+    uavsId[uavsName[i]] = i;
+  }
+
+  // RPC, read-only state plus the current time
+  std::atomic<uint32_t> tick(0);
+  std::atomic<double> simTime(0.0);
+  rpc::server server(STANDIN_RPC_PORT);
+  server.bind("ping", []() -> bool {return true;});
+  server.bind("getServerVersion", []() -> int {return STANDIN_SERVER_VERSION;});
+  server.bind("getMinRequiredClientVersion", []() -> int {return STANDIN_MIN_CLIENT_VERSION;});
+  server.bind("simGetGroundTruthKinematics", [&](const std::string &vehicleName) -> msr::airlib_rpclib::RpcLibAdapatorsBase::KinematicsState {
+    auto it = uavsId.find(vehicleName);
+    if(it == uavsId.end()){
+      rpc::this_handler().respond_error("unknown vehicle " + vehicleName);
+      return msr::airlib_rpclib::RpcLibAdapatorsBase::KinematicsState(msr::airlib::Kinematics::State::zero());
+    }
+    double t = simTime.load();
+    return msr::airlib_rpclib::RpcLibAdapatorsBase::KinematicsState(trajectory.at(it->second, t));
+  });
+  server.async_run(STANDIN_RPC_THREADS);
+
+  // control channel
+  zmq::socket_t ctrlSend(context, ZMQ_PUSH);
+  ctrlSend.bind("tcp://*:" + to_string(AIRSIM2NS_CTRL_PORT));
+  zmq::socket_t ctrlRecv(context, ZMQ_PULL);
+  ctrlRecv.connect("tcp://localhost:" + to_string(NS2AIRSIM_CTRL_PORT));
+  MuxPeer uavMux(context, AIRSIM2NS_UAV_PORT, NS2AIRSIM_UAV_PORT);
+  MuxPeer gcsMux(context, AIRSIM2NS_GCS_PORT, NS2AIRSIM_GCS_PORT);
+
+  std::string blob = msgpackConfig
+    ? netConfigMsgpack(updateGranularity, uavsName, numOfCong, congRate, useWifi, usePoseStream, asyncAck, lookahead, maxGranularity, netState, udpClasses)
+    : netConfigBlob(updateGranularity, uavsName, numOfCong, congRate, useWifi, usePoseStream, asyncAck, lookahead, maxGranularity, netState, udpClasses);
+  if(!netConfigOut.empty()){
+    std::ofstream file(netConfigOut, std::ios::binary);
+    file.write(blob.data(), blob.size());
+    NS_LOG_UNCOND("[StandIn] NetConfig written to " << netConfigOut << ", waiting for ns --netConfig with " << numOfUav << " UAVs");
+  }
+  else{
+    zmq::message_t config(blob.data(), blob.size());
+    ctrlSend.send(config, zmq::send_flags::none);
+    NS_LOG_UNCOND("[StandIn] NetConfig sent, waiting for ns with " << numOfUav << " UAVs");
+  }
+
+  // startAirSim()
+  zmq::message_t ntf;
+  ctrlRecv.recv(ntf, zmq::recv_flags::none);
+
+  // block until ns grants at least tick, keeping the step suggested for every granted tick
+  int64_t granted = -1;
+  std::map<uint32_t, float> steps;
+  uint64_t netStateFrames = 0;
+  NetStateEntry lastNetState; // of vehicle 0
+  memset(&lastNetState, 0, sizeof(lastNetState));
+  auto waitGrant = [&](uint32_t tick){
+    // ns never grants in realtime mode
+    while(!realtime && granted < (int64_t)tick){
+      ctrlRecv.recv(ntf, zmq::recv_flags::none);
+      if(ctrlFrameType(ntf.data(), ntf.size()) == CTRL_FRAME_GRANT){
+        GrantFrame frame;
+        memcpy(&frame, ntf.data(), sizeof(frame));
+        granted = std::max(granted, (int64_t)frame.hdr.tick);
+        steps[frame.hdr.tick] = frame.step;
+      }
+      else if(ctrlFrameType(ntf.data(), ntf.size()) == CTRL_FRAME_NET_STATE){
+        NetStateHeader hdr;
+        memcpy(&hdr, ntf.data(), sizeof(hdr));
+        if(hdr.count > 0 && ntf.size() >= sizeof(hdr) + hdr.count * sizeof(NetStateEntry)){
+          memcpy(&lastNetState, static_cast<const uint8_t*>(ntf.data()) + sizeof(hdr), sizeof(lastNetState));
+        }
+        netStateFrames++;
+      }
+    }
+  };
+
+  std::string payload(msgSize, 'x');
+  auto wallStart = std::chrono::steady_clock::now();
+  for(; tick.load() < ticks; tick++){
+    uint32_t now = tick.load();
+    TickFrame done;
+    memset(&done, 0, sizeof(done));
+    done.hdr.type = CTRL_FRAME_TICK;
+    done.hdr.magic = CTRL_FRAME_MAGIC;
+    done.hdr.tick = now;
+    waitGrant(now);
+    bool hasTraffic = (trafficEvery <= 1) || (now % trafficEvery == 0);
+    // in lockstep a pose frame ends the turn and has no room for the step taken
+    bool sendsTickFrame = !realtime && (!usePoseStream || lookahead > 0);
+
+    // take the suggested step unless there is traffic to send, ticks before the first grant are fine
+    done.step = updateGranularity;
+    auto suggested = steps.find(now);
+    if(suggested != steps.end()){
+      if(sendsTickFrame && !hasTraffic && suggested->second > 0){
+        done.step = suggested->second;
+      }
+      steps.erase(suggested);
+    }
+
+    for(int i = 0; hasTraffic && i < numOfUav; i++){
+      for(uint32_t m = 0; m < uavMsgsPerTick; m++){
+        int64_t offsetNs = spreadSends ? (int64_t)(done.step * 1e9 * m / uavMsgsPerTick) : 0;
+        done.uavMsgs += uavMux.sendMessage(i, payload, offsetNs, msgClass);
+      }
+      for(uint32_t m = 0; m < gcsMsgsPerTick; m++){
+        int64_t offsetNs = spreadSends ? (int64_t)(done.step * 1e9 * m / gcsMsgsPerTick) : 0;
+        done.gcsMsgs += gcsMux.sendMessage(i, payload, offsetNs, msgClass);
+      }
+    }
+    uavMux.drainAcks();
+    gcsMux.drainAcks();
+    uavMux.drainReceived();
+    gcsMux.drainReceived();
+
+    // end of turn, in lockstep the pose frame is enough
+    if(usePoseStream){
+      zmq::message_t frame = poseFrame(now, trajectory, numOfUav, simTime.load() + done.step);
+      ctrlSend.send(frame, zmq::send_flags::none);
+    }
+    if(sendsTickFrame){
+      zmq::message_t frame(&done, sizeof(done));
+      ctrlSend.send(frame, zmq::send_flags::none);
+    }
+    simTime = simTime.load() + done.step;
+    if(realtime){
+      std::this_thread::sleep_until(wallStart + std::chrono::duration<double>(simTime.load()));
+    }
+  }
+  waitGrant(ticks);
+  CtrlFrameHeader bye;
+  memset(&bye, 0, sizeof(bye));
+  bye.type = CTRL_FRAME_BYE;
+  bye.magic = CTRL_FRAME_MAGIC;
+  bye.tick = ticks;
+  zmq::message_t byeFrame(&bye, sizeof(bye));
+  ctrlSend.send(byeFrame, zmq::send_flags::none);
+  // ns answers bye with one last grant
+  if(!realtime){
+    ctrlRecv.recv(ntf, zmq::recv_flags::none);
+  }
+  uavMux.drainAcks();
+  gcsMux.drainAcks();
+
+  NS_LOG_UNCOND("[StandIn] UAV -> GCS sent= " << uavMux.sent << " dropped= " << uavMux.dropped << " acked= " << uavMux.acked << " failed= " << uavMux.failed);
+  NS_LOG_UNCOND("[StandIn] GCS -> UAV sent= " << gcsMux.sent << " dropped= " << gcsMux.dropped << " acked= " << gcsMux.acked << " failed= " << gcsMux.failed);
+  if(netState){
+    NS_LOG_UNCOND("[StandIn] net state frames= " << netStateFrames << ", last of vehicle 0: valid= " << lastNetState.valid
+      << " cell= " << lastNetState.cell << " sinr= " << lastNetState.sinrDb << " dB rssi= " << lastNetState.rssiDbm << " dBm cwnd= " << lastNetState.cwnd
+      << " rtt= " << lastNetState.rttMs << " ms queued= " << lastNetState.bytesQueued << " up= " << lastNetState.bytesUp << " down= " << lastNetState.bytesDown);
+  }
+  NS_LOG_UNCOND("[StandIn] delivered to UAVs= " << uavMux.received << " (" << uavMux.receivedBytes << " B), to GCS= " << gcsMux.received << " (" << gcsMux.receivedBytes << " B)");
+
+  server.stop();
+  return 0;
+}
@@ -1,5 +1,10 @@
 // standard includes
 #include <sstream>
+#include <fstream>
+#include <iterator>
+#include <set>
+#include <cstring>
+#include <algorithm>
 // ns3 includes
 #include "ns3/core-module.h"
 #include "ns3/network-module.h"
@@ -20,17 +25,29 @@ STRICT_MODE_OFF
 #define RPCLIB_MSGPACK clmdep_msgpack
 #endif // !RPCLIB_MSGPACK
 #include "rpc/rpc_error.h"
+#include "rpc/msgpack.hpp"
 STRICT_MODE_ON
 #include "vehicles/multirotor/api/MultirotorRpcLibClient.hpp"
 #include "common/common_utils/FileSystem.hpp"
 // custom includes
 #include "AirSimSync.h"
+#include "traceLog.h"
 
 using namespace std;
 extern NetConfig config;
 
 NS_LOG_COMPONENT_DEFINE("AIRSIM_SYNC");
 
+// keep the default if the field is absent, unlike operator>> which zeroes it
+template<typename T>
+static void readOptional(istream &is, T &field)
+{
+    T value;
+    if(is >> value){
+        field = value;
+    }
+}
+
 std::istream& operator>>(istream & is, NetConfig &config)
 {
     int numOfUav, numOfEnb;
@@ -56,9 +73,150 @@ std::istream& operator>>(istream & is, NetConfig &config)
     is >> config.useWifi;
     
     is >> config.isMainLogEnabled >> config.isGcsLogEnabled >> config.isUavLogEnabled >> config.isCongLogEnabled >> config.isSyncLogEnabled;
+    if(!is){
+        // truncated, the caller sees the failbit
+        return is;
+    }
+
+    readOptional(is, config.usePoseStream);
+    readOptional(is, config.asyncAck);
+    readOptional(is, config.lookahead);
+    readOptional(is, config.maxGranularity);
+    readOptional(is, config.netState);
+    readOptional(is, config.udpClasses);
+    // running out of optional fields is fine, a malformed one is not
+    if(is.fail() && is.eof()){
+        is.clear(std::ios::eofbit);
+    }
 
     return is;
 }
+
+template<typename T>
+static void readField(const RPCLIB_MSGPACK::object &value, const std::string &key, T &field)
+{
+    try{
+        field = value.as<T>();
+    }
+    catch(const std::exception &e){
+        NS_FATAL_ERROR("NetConfig field " << key << " has the wrong type: " << e.what());
+    }
+}
+bool decodeNetConfig(const void *data, std::size_t size, NetConfig &config)
+{
+    const uint8_t *bytes = static_cast<const uint8_t*>(data);
+    RPCLIB_MSGPACK::object_handle handle;
+    int version = -1;
+    bool hasUavs = false, hasEnbs = false;
+
+    // a map, the text blob starts with a number
+    if(size == 0 || !((bytes[0] & 0xF0) == 0x80 || bytes[0] == 0xDE || bytes[0] == 0xDF)){
+        return false;
+    }
+    try{
+        handle = RPCLIB_MSGPACK::unpack(static_cast<const char*>(data), size);
+    }
+    catch(const std::exception &e){
+        NS_FATAL_ERROR("NetConfig is not valid msgpack: " << e.what());
+    }
+
+    const RPCLIB_MSGPACK::object &root = handle.get();
+    for(uint32_t i = 0; i < root.via.map.size; i++){
+        const RPCLIB_MSGPACK::object &value = root.via.map.ptr[i].val;
+        std::string key;
+        readField(root.via.map.ptr[i].key, "name", key);
+
+        if(key == "version") {readField(value, key, version);}
+        else if(key == "updateGranularity") {readField(value, key, config.updateGranularity);}
+        else if(key == "segmentSize") {readField(value, key, config.segmentSize);}
+        else if(key == "numOfCong") {readField(value, key, config.numOfCong);}
+        else if(key == "congRate") {readField(value, key, config.congRate);}
+        else if(key == "congX") {readField(value, key, config.congX);}
+        else if(key == "congY") {readField(value, key, config.congY);}
+        else if(key == "congRho") {readField(value, key, config.congRho);}
+        else if(key == "uavsName") {readField(value, key, config.uavsName); hasUavs = true;}
+        else if(key == "initEnbApPos") {readField(value, key, config.initEnbApPos); hasEnbs = true;}
+        else if(key == "nRbs") {readField(value, key, config.nRbs);}
+        else if(key == "TcpSndBufSize") {readField(value, key, config.TcpSndBufSize);}
+        else if(key == "TcpRcvBufSize") {readField(value, key, config.TcpRcvBufSize);}
+        else if(key == "CqiTimerThreshold") {readField(value, key, config.CqiTimerThreshold);}
+        else if(key == "LteTxPower") {readField(value, key, config.LteTxPower);}
+        else if(key == "p2pDataRate") {readField(value, key, config.p2pDataRate);}
+        else if(key == "p2pMtu") {readField(value, key, config.p2pMtu);}
+        else if(key == "p2pDelay") {readField(value, key, config.p2pDelay);}
+        else if(key == "useWifi") {readField(value, key, config.useWifi);}
+        else if(key == "isMainLogEnabled") {readField(value, key, config.isMainLogEnabled);}
+        else if(key == "isGcsLogEnabled") {readField(value, key, config.isGcsLogEnabled);}
+        else if(key == "isUavLogEnabled") {readField(value, key, config.isUavLogEnabled);}
+        else if(key == "isCongLogEnabled") {readField(value, key, config.isCongLogEnabled);}
+        else if(key == "isSyncLogEnabled") {readField(value, key, config.isSyncLogEnabled);}
+        else if(key == "usePoseStream") {readField(value, key, config.usePoseStream);}
+        else if(key == "asyncAck") {readField(value, key, config.asyncAck);}
+        else if(key == "lookahead") {readField(value, key, config.lookahead);}
+        else if(key == "maxGranularity") {readField(value, key, config.maxGranularity);}
+        else if(key == "netState") {readField(value, key, config.netState);}
+        else if(key == "udpClasses") {readField(value, key, config.udpClasses);}
+        else{
+            // added by a newer AirSim, same version
+            NS_LOG_WARN("NetConfig: ignore unknown field " << key);
+        }
+    }
+
+    if(version < 0){
+        NS_FATAL_ERROR("NetConfig has no version");
+    }
+    if(version > NET_CONFIG_VERSION){
+        NS_FATAL_ERROR("NetConfig version " << version << " is newer than the supported " << NET_CONFIG_VERSION);
+    }
+    if(!hasUavs || !hasEnbs){
+        NS_FATAL_ERROR("NetConfig needs both uavsName and initEnbApPos");
+    }
+    return true;
+}
+void validateNetConfig(const NetConfig &config)
+{
+    std::set<std::string> names;
+
+    if(!(config.updateGranularity > 0)){
+        NS_FATAL_ERROR("NetConfig updateGranularity must be positive, got " << config.updateGranularity);
+    }
+    if(config.maxGranularity < 0 || config.lookahead < 0){
+        NS_FATAL_ERROR("NetConfig maxGranularity and lookahead cannot be negative");
+    }
+    // a pose frame ends the turn in lockstep and carries no step, ns would keep running updateGranularity
+    if(config.usePoseStream && config.lookahead == 0 && config.maxGranularity > config.updateGranularity){
+        NS_LOG_WARN("NetConfig maxGranularity " << config.maxGranularity << " needs lookahead with usePoseStream, ticks stay at updateGranularity " << config.updateGranularity);
+    }
+    if(config.segmentSize <= 0 || config.p2pMtu == 0 || config.nRbs <= 0){
+        NS_FATAL_ERROR("NetConfig segmentSize, p2pMtu and nRbs must be positive");
+    }
+    if(config.udpClasses && config.p2pMtu <= UDP_IP_OVERHEAD + DatagramHeader().GetSerializedSize()){
+        NS_FATAL_ERROR("NetConfig p2pMtu " << config.p2pMtu << " leaves no room for UDP message fragments");
+    }
+    if(config.numOfCong < 0 || config.congRate < 0){
+        NS_FATAL_ERROR("NetConfig numOfCong and congRate cannot be negative");
+    }
+    if(config.useWifi != 0 && config.useWifi != 1){
+        NS_FATAL_ERROR("NetConfig useWifi must be 0 or 1, got " << config.useWifi);
+    }
+    if(config.initEnbApPos.empty()){
+        NS_FATAL_ERROR("NetConfig initEnbApPos needs at least one position");
+    }
+    for(std::size_t i = 0; i < config.initEnbApPos.size(); i++){
+        if(config.initEnbApPos[i].size() != 3){
+            NS_FATAL_ERROR("NetConfig initEnbApPos[" << i << "] has " << config.initEnbApPos[i].size() << " coordinates, expected 3");
+        }
+    }
+    // vehicle ids are 16 bit with MSG_NO_VEHICLE reserved
+    if(config.uavsName.size() >= MSG_NO_VEHICLE){
+        NS_FATAL_ERROR("NetConfig uavsName has " << config.uavsName.size() << " UAVs, at most " << MSG_NO_VEHICLE - 1 << " fit a vehicle id");
+    }
+    for(auto &it:config.uavsName){
+        if(it.empty() || !names.insert(it).second){
+            NS_FATAL_ERROR("NetConfig uavsName has an empty or duplicate name '" << it << "'");
+        }
+    }
+}
 std::ostream& operator<<(ostream & os, const NetConfig &config)
 {
     os << "update granularity: " << config.updateGranularity << endl;
@@ -80,11 +238,11 @@ std::ostream& operator<<(ostream & os, const NetConfig &config)
     os << "nRbs: " << config.nRbs << ", TcpSndBufSize:" << config.TcpSndBufSize << ", TcpRcvBufSize:" << config.TcpRcvBufSize << endl;
     os << "CqiTimerThreshold: " << config.CqiTimerThreshold << ", LteTxPower: " << config.LteTxPower << ", p2pDataRate:" << config.p2pDataRate << ", p2pMtu: " << config.p2pMtu << ", p2pDelay: " << config.p2pDelay << endl;
     
-    os << "useWifi: " << config.useWifi;
+    os << "useWifi: " << config.useWifi << ", usePoseStream: " << config.usePoseStream << ", asyncAck: " << config.asyncAck << ", lookahead: " << config.lookahead << ", maxGranularity: " << config.maxGranularity << ", netState: " << config.netState << ", udpClasses: " << config.udpClasses;
     return os;
 }
 
-AirSimSync::AirSimSync(zmq::context_t &context): event()
+AirSimSync::AirSimSync(zmq::context_t &context, SessionLog *sessionLog): event(), ioStop(false), sessionLog(sessionLog)
 {
     zmqRecvSocket = zmq::socket_t(context, ZMQ_PULL);
     zmqRecvSocket.connect("tcp://localhost:" + to_string(AIRSIM2NS_CTRL_PORT));
@@ -97,75 +255,471 @@ AirSimSync::~AirSimSync()
     zmqSendSocket.close();
 }
 
-void AirSimSync::readNetConfigFromAirSim(NetConfig &config)
+void AirSimSync::readNetConfig(NetConfig &config, const std::string &path)
 {
-    zmq::message_t message;
-    zmqRecvSocket.recv(message, zmq::recv_flags::none);
-    std::string s(static_cast<char*>(message.data()), message.size());
-    std::istringstream ss(s);
-    
-    ss >> config;
+    std::string s;
+
+    if(!path.empty() && !(sessionLog && sessionLog->isReplay())){
+        std::ifstream file(path, std::ios::binary);
+        if(!file){
+            NS_FATAL_ERROR("cannot read NetConfig from " << path);
+        }
+        s.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+        // replayed like one received from AirSim
+        if(sessionLog){
+            sessionLog->write(LOG_NET_CONFIG, 0, s.data(), s.size());
+        }
+    }
+    else{
+        zmq::message_t message;
+        recvControl(message, LOG_NET_CONFIG);
+        s.assign(static_cast<char*>(message.data()), message.size());
+    }
+
+    if(!decodeNetConfig(s.data(), s.size(), config)){
+        std::istringstream ss(s);
+        if(!(ss >> config)){
+            NS_FATAL_ERROR("NetConfig text blob is truncated or malformed");
+        }
+    }
+    validateNetConfig(config);
     updateGranularity = config.updateGranularity;
+    lookahead = std::max(0, config.lookahead);
+    maxGranularity = std::max(config.maxGranularity, updateGranularity);
+    if(config.usePoseStream && lookahead == 0){
+        maxGranularity = updateGranularity;
+    }
+    step = updateGranularity;
+    if(lookahead > 0 && !config.usePoseStream){
+        NS_LOG_WARN("lookahead without usePoseStream, poses fetched by RPC are up to " << lookahead << " ticks ahead");
+    }
     // rm timeout
     // zmqRecvSocket.setsockopt(ZMQ_RCVTIMEO, (int)(1000*1000*config.updateGranularity));
 }
+zmq::recv_result_t AirSimSync::recvControl(zmq::message_t &message, uint16_t logType)
+{
+    zmq::recv_result_t res;
+
+    if(sessionLog && sessionLog->isReplay()){
+        const uint8_t *data;
+        std::size_t size;
+        while(!sessionLog->read(logType, 0, data, size)){
+            if(!sessionLog->skip()){
+                // the recorded session ends as if AirSim said bye
+                CtrlFrameHeader bye;
+                memset(&bye, 0, sizeof(bye));
+                bye.type = CTRL_FRAME_BYE;
+                bye.magic = CTRL_FRAME_MAGIC;
+                bye.tick = tick;
+                message.rebuild(&bye, sizeof(bye));
+                return zmq::recv_result_t(message.size());
+            }
+        }
+        message.rebuild(data, size);
+        return zmq::recv_result_t(message.size());
+    }
+
+    res = zmqRecvSocket.recv(message, zmq::recv_flags::none);
+    if(sessionLog && res.has_value()){
+        sessionLog->write(logType, 0, message.data(), message.size());
+    }
+    return res;
+}
 void AirSimSync::startAirSim()
 {
     zmq::message_t ntf(1);
+    // nobody listens when replaying, a blocking send would never return
+    if(sessionLog && sessionLog->isReplay()){
+        return;
+    }
     // notify AirSim
     zmqSendSocket.send(ntf, zmq::send_flags::none);
 }
+void AirSimSync::setUavsMobility(std::vector< Ptr<AirSimMobilityModel> > uavsMobility)
+{
+    this->uavsMobility = uavsMobility;
+    lastPos = std::vector<Vector>(uavsMobility.size());
+}
+void AirSimSync::setUavMux(ZmqMux *uavMux)
+{
+    this->uavMux = uavMux;
+}
+void AirSimSync::setGcsMux(ZmqMux *gcsMux)
+{
+    this->gcsMux = gcsMux;
+}
+void AirSimSync::setProfiler(TickProfiler *profiler)
+{
+    this->profiler = profiler;
+}
+void AirSimSync::setNetStateMonitor(NetStateMonitor *netState)
+{
+    this->netState = netState;
+}
+void AirSimSync::setFlowStats(FlowStats *flowStats)
+{
+    this->flowStats = flowStats;
+}
+void AirSimSync::setMsgLatency(MsgLatency *msgLatency)
+{
+    this->msgLatency = msgLatency;
+}
+bool AirSimSync::applyPoseFrame(const zmq::message_t &message)
+{
+    PoseFrameHeader hdr;
+    const uint8_t *p = static_cast<const uint8_t*>(message.data());
+
+    if(poseFrameSize(p, message.size()) == 0){
+        return false;
+    }
+    memcpy(&hdr, p, sizeof(hdr));
+    p += sizeof(hdr);
+
+    for(int i = 0; i < hdr.count; i++, p += poseEntrySize(hdr.flags)){
+        uint16_t id;
+        Vector vel, acc;
+        memcpy(&id, p, sizeof(id));
+        if(id >= uavsMobility.size()){
+            NS_LOG_WARN("pose frame " << hdr.tick << " refers to unknown vehicle " << id);
+            continue;
+        }
+        if(hdr.flags & POSE_FLAG_DELTA){
+            PoseDeltaEntry entry;
+            memcpy(&entry, p, sizeof(entry));
+            lastPos[id].x += entry.dpos[0] / POSE_DELTA_POS_SCALE;
+            lastPos[id].y += entry.dpos[1] / POSE_DELTA_POS_SCALE;
+            lastPos[id].z += entry.dpos[2] / POSE_DELTA_POS_SCALE;
+            vel = Vector(entry.vel[0] / POSE_DELTA_VEL_SCALE, entry.vel[1] / POSE_DELTA_VEL_SCALE, entry.vel[2] / POSE_DELTA_VEL_SCALE);
+            if(hdr.flags & POSE_FLAG_ACCEL){
+                PoseDeltaAccel accel;
+                memcpy(&accel, p + sizeof(entry), sizeof(accel));
+                acc = Vector(accel.acc[0] / POSE_DELTA_ACC_SCALE, accel.acc[1] / POSE_DELTA_ACC_SCALE, accel.acc[2] / POSE_DELTA_ACC_SCALE);
+            }
+        }
+        else{
+            PoseEntry entry;
+            memcpy(&entry, p, sizeof(entry));
+            lastPos[id] = Vector(entry.pos[0], entry.pos[1], entry.pos[2]);
+            vel = Vector(entry.vel[0], entry.vel[1], entry.vel[2]);
+            if(hdr.flags & POSE_FLAG_ACCEL){
+                PoseAccel accel;
+                memcpy(&accel, p + sizeof(entry), sizeof(accel));
+                acc = Vector(accel.acc[0], accel.acc[1], accel.acc[2]);
+            }
+        }
+        uavsMobility[id]->SetKinematics(lastPos[id], vel, acc);
+    }
+    return true;
+}
+void AirSimSync::grant(uint32_t tick, float step)
+{
+    GrantFrame frame;
+    memset(&frame, 0, sizeof(frame));
+    frame.hdr.type = CTRL_FRAME_GRANT;
+    frame.hdr.magic = CTRL_FRAME_MAGIC;
+    frame.hdr.tick = tick;
+    frame.step = step;
+    zmq::message_t ntf(&frame, sizeof(frame));
+
+    zmqSendSocket.send(ntf, zmq::send_flags::dontwait);
+}
+/*
+* Fine steps while anything was sent or is still in flight between the apps,
+* doubling up to maxGranularity for every tick the network stays idle.
+* Pending ns-3 events are no hint, LTE alone schedules one every subframe.
+*/
+float AirSimSync::suggestStep(Ptr<GcsApp> &gcsApp, std::vector< Ptr<UavApp> > &uavsApp)
+{
+    uint64_t txBytes = gcsApp->getTxBytes();
+    uint64_t udpTxBytes = gcsApp->getUdpTxBytes();
+    uint64_t udpRxBytes = gcsApp->getUdpRxBytes();
+    uint64_t rxBytes = gcsApp->getRxBytes();
+
+    if(maxGranularity <= updateGranularity){
+        return updateGranularity;
+    }
+    for(auto &it:uavsApp){
+        txBytes += it->getTxBytes();
+        rxBytes += it->getRxBytes();
+        udpTxBytes += it->getUdpTxBytes();
+        udpRxBytes += it->getUdpRxBytes();
+    }
+    // a lost datagram never arrives, only TCP bytes are surely still in flight
+    bool busy = (txBytes != lastTxBytes) || (txBytes - udpTxBytes > rxBytes - udpRxBytes);
+    lastTxBytes = txBytes;
+
+    step = busy ? updateGranularity : std::min(step * 2, maxGranularity);
+    return step;
+}
 void AirSimSync::takeTurn(Ptr<GcsApp> &gcsApp, std::vector< Ptr<UavApp> > &uavsApp)
 {
     float now = Simulator::Now().GetSeconds();
     zmq::message_t message;
     zmq::recv_result_t res;
-    zmq::message_t ntf(1);
+    uint32_t current = tick;
+    float nextStep = updateGranularity;
+    std::size_t uavMsgs = MUX_DRAIN_ALL;
+    std::size_t gcsMsgs = MUX_DRAIN_ALL;
+    bool hasPoses = false;
+    bool bye = false;
+    auto wallStart = std::chrono::steady_clock::now();
     
-    // notify AirSim
-    zmqSendSocket.send(ntf, zmq::send_flags::dontwait);
+    if(sessionLog){
+        sessionLog->setTick(tick);
+    }
+    if(profiler){
+        profiler->beginTick(tick, now);
+    }
+    TraceLog::setTick(tick);
+    tick++;
+
+    // the network as the tick ends, AirSim reads it before the grant
+    if(netState){
+        zmq::message_t frame = netState->frame(current, gcsApp, uavsApp);
+        zmqSendSocket.send(frame, zmq::send_flags::dontwait);
+    }
+    if(flowStats){
+        flowStats->sample(current);
+    }
+    if(msgLatency){
+        msgLatency->sample(current);
+    }
+    // notify AirSim, it may already be up to lookahead ticks ahead
+    grant(current + lookahead, suggestStep(gcsApp, uavsApp));
+    if(profiler){
+        profiler->mark(PHASE_REPORT);
+    }
     
     // AirSim's turn at time t
-    // block until AirSim sends any (nofitied by AirSim)
-    res = zmqRecvSocket.recv(message, zmq::recv_flags::none);
+    // its control frames come in tick order, read them until the end of tick t,
+    // frames of later ticks stay queued in zmq
+    while(true){
+        res = recvControl(message, LOG_CTRL);
+        if(!res.has_value()){
+            NS_LOG_INFO("Termination triggered by has_value() is false");
+            bye = true;
+            break;
+        }
+        uint8_t type = ctrlFrameType(message.data(), message.size());
+        if(type == CTRL_FRAME_TICK){
+            TickFrame frame;
+            memcpy(&frame, message.data(), sizeof(frame));
+            if(frame.hdr.tick != current){
+                NS_LOG_WARN("end of tick " << frame.hdr.tick << " received at tick " << current);
+            }
+            uavMsgs = frame.uavMsgs;
+            gcsMsgs = frame.gcsMsgs;
+            if(frame.step > 0){
+                nextStep = frame.step;
+            }
+            break;
+        }
+        if(type == CTRL_FRAME_BYE){
+            bye = true;
+            break;
+        }
+        if(applyPoseFrame(message)){
+            hasPoses = true;
+            // a pose frame doubles as AirSim's end of turn in lockstep
+            if(lookahead == 0){
+                break;
+            }
+            continue;
+        }
+        // untyped, older AirSim builds end their turn with any message and the session with "bye"
+        std::string s(static_cast<char*>(message.data()), message.size());
+        bye = (s.find("bye") != std::string::npos);
+        break;
+    }
     NS_LOG_INFO("TIME: " << now);
-    
-    std::string s(static_cast<char*>(message.data()), message.size());
-    std::size_t n = s.find("bye");
-    // This implied that a hard limit of 10 times updateGranularity for AirSim to run a period
-    if((!res.has_value() || res.value() < 0) || (n != std::string::npos)){
+    if(profiler){
+        profiler->mark(PHASE_WAIT);
+    }
+
+    if(bye){
         double endTime = 0.0;
         if(event.IsRunning()){
             Simulator::Cancel(event);
         }
-        zmqSendSocket.send(ntf, zmq::send_flags::dontwait);
+        grant(current, 0);
         gcsApp->SetStopTime(Seconds(endTime));
         for(auto &it:uavsApp){
             it->SetStopTime(Seconds(endTime));
         }
-        if(n == std::string::npos){
-            NS_LOG_INFO("Termination triggered by timeout");
-        }
-        if(!res.has_value()){
-            NS_LOG_INFO("Termination triggered by has_value() is false");
-        }
-        if(res.has_value() && res.value() < 0){
-            NS_LOG_INFO("Termination triggered by res value " << res.value());
-        }
+        NS_LOG_INFO("Termination at tick " << current);
         Simulator::Stop(Seconds(endTime));
     }
     
     // ns' turn at time t, AirSim at time t + 1
     // packet send
-    gcsApp->mobilityUpdateDirect();
+    if(!hasPoses){
+        gcsApp->mobilityUpdateDirect();
+    }
+    if(profiler){
+        profiler->mark(PHASE_MOBILITY);
+    }
     if(gcsApp){
-        gcsApp->scheduleTx();
+        gcsApp->scheduleTx(Seconds(nextStep), gcsMsgs);
     }
-    for(int i = 0; i < uavsApp.size(); i++){
-        uavsApp[i]->scheduleTx();
+    if(profiler){
+        profiler->mark(PHASE_GCS_DRAIN);
+    }
+    // fan messages out to UAVs by vehicle id
+    // offsets are into the tick AirSim just finished, which ns runs from now on
+    Time step = Seconds(nextStep);
+    uavMux->drain([&uavsApp, step](const MsgHeader &hdr, zmq::message_t &payload){
+        if(hdr.vehicleId >= uavsApp.size()){
+            NS_LOG_WARN("[UAV mux] drop a packet supposed to be sent by vehicle " << hdr.vehicleId);
+            return -1;
+        }
+        return uavsApp[hdr.vehicleId]->scheduleTx(payload, ZmqMux::sendDelay(hdr, step), hdr.msgClass);
+    }, uavMsgs);
+    if(profiler){
+        profiler->mark(PHASE_UAV_DRAIN);
+        profiler->endTick();
     }
 
-    // will fire at time t + 1
-    Time tNext(Seconds(updateGranularity));
+    // will fire at time t + 1, as long as AirSim ran this tick
+    Time tNext(Seconds(nextStep));
     event = Simulator::Schedule(tNext, &AirSimSync::takeTurn, this, gcsApp, uavsApp);
+    turnWallTimes.add(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - wallStart).count());
+}
+
+void AirSimSync::startRealtime(Ptr<GcsApp> &gcsApp, std::vector< Ptr<UavApp> > &uavsApp, Time lagInterval)
+{
+    std::vector<UavApp*> uavs;
+
+    // raw pointers, Ptr reference counts are not thread safe
+    for(auto &it:uavsApp){
+        uavs.push_back(PeekPointer(it));
+    }
+    uavMux->disableAcks();
+    gcsMux->disableAcks();
+    if(!config.usePoseStream){
+        Simulator::ScheduleNow(&AirSimSync::realtimeMobility, this, PeekPointer(gcsApp));
+    }
+    if(lagInterval.IsStrictlyPositive()){
+        Simulator::Schedule(lagInterval, &AirSimSync::reportLag, this, lagInterval);
+    }
+    if(netState || flowStats || msgLatency){
+        Simulator::ScheduleNow(&AirSimSync::realtimeSample, this, gcsApp, uavsApp);
+    }
+    ioThread = std::thread(&AirSimSync::ioLoop, this, PeekPointer(gcsApp), uavs);
+}
+void AirSimSync::stopRealtime(void)
+{
+    ioStop = true;
+    if(ioThread.joinable()){
+        ioThread.join();
+    }
+    NS_LOG_INFO("realtime max lag= " << maxLag * 1000 << " ms");
+}
+
+void AirSimSync::ioLoop(GcsApp *gcsApp, std::vector<UavApp*> uavsApp)
+{
+    uint32_t gcsContext = gcsApp->GetNode()->GetId();
+    std::vector<uint32_t> uavContexts;
+    zmq::pollitem_t items[] = {
+        {static_cast<void*>(zmqRecvSocket), 0, ZMQ_POLLIN, 0},
+        uavMux->getPollItem(),
+        gcsMux->getPollItem()
+    };
+
+    for(auto it:uavsApp){
+        uavContexts.push_back(it->GetNode()->GetId());
+    }
+
+    while(!ioStop.load()){
+        zmq::poll(items, 3, std::chrono::milliseconds(REALTIME_POLL_TIMEOUT_MS));
+
+        if(items[0].revents & ZMQ_POLLIN){
+            auto message = std::make_shared<zmq::message_t>();
+            while(zmqRecvSocket.recv(*message, zmq::recv_flags::dontwait)){
+                uint8_t type = ctrlFrameType(message->data(), message->size());
+                if(type == CTRL_FRAME_BYE){
+                    Simulator::ScheduleWithContext(Simulator::NO_CONTEXT, Seconds(0), static_cast<void (*)(void)>(&Simulator::Stop));
+                }
+                else if(poseFrameSize(message->data(), message->size())){
+                    Simulator::ScheduleWithContext(Simulator::NO_CONTEXT, Seconds(0), &AirSimSync::deliverPoses, this, message);
+                }
+                // tick frames have no meaning here
+                message = std::make_shared<zmq::message_t>();
+            }
+        }
+        if(items[1].revents & ZMQ_POLLIN){
+            // messages arrive on the wall clock, send offsets do not apply
+            uavMux->drain([&](const MsgHeader &hdr, zmq::message_t &payload){
+                if(hdr.vehicleId >= uavsApp.size()){
+                    NS_LOG_WARN("[UAV mux] drop a packet supposed to be sent by vehicle " << hdr.vehicleId);
+                    return -1;
+                }
+                auto message = std::make_shared<zmq::message_t>(std::move(payload));
+                Simulator::ScheduleWithContext(uavContexts[hdr.vehicleId], Seconds(0), &AirSimSync::deliverToUav, uavsApp[hdr.vehicleId], message, hdr.msgClass);
+                return 0;
+            });
+        }
+        if(items[2].revents & ZMQ_POLLIN){
+            gcsMux->drain([&](const MsgHeader &hdr, zmq::message_t &payload){
+                auto message = std::make_shared<zmq::message_t>(std::move(payload));
+                Simulator::ScheduleWithContext(gcsContext, Seconds(0), &AirSimSync::deliverToGcs, gcsApp, hdr.vehicleId, message, hdr.msgClass);
+                return 0;
+            });
+        }
+    }
+}
+void AirSimSync::deliverToUav(UavApp *app, std::shared_ptr<zmq::message_t> message, uint8_t msgClass)
+{
+    app->scheduleTx(*message, Seconds(0), msgClass);
+}
+void AirSimSync::deliverToGcs(GcsApp *app, uint16_t vehicleId, std::shared_ptr<zmq::message_t> message, uint8_t msgClass)
+{
+    if(vehicleId >= config.uavsName.size()){
+        NS_LOG_WARN("[GCS mux] drop a packet supposed to be sent to vehicle " << vehicleId);
+        return;
+    }
+    app->sendToUav(vehicleId, *message, Seconds(0), msgClass);
+}
+void AirSimSync::deliverPoses(std::shared_ptr<zmq::message_t> message)
+{
+    applyPoseFrame(*message);
+}
+// AirSim is polled at the configured granularity when it does not push poses
+void AirSimSync::realtimeMobility(GcsApp *gcsApp)
+{
+    gcsApp->mobilityUpdateDirect();
+    Simulator::Schedule(Seconds(updateGranularity), &AirSimSync::realtimeMobility, this, gcsApp);
+}
+void AirSimSync::reportLag(Time interval)
+{
+    Ptr<RealtimeSimulatorImpl> impl = DynamicCast<RealtimeSimulatorImpl>(Simulator::GetImplementation());
+    double now = Simulator::Now().GetSeconds();
+
+    if(impl){
+        double lag = impl->RealtimeNow().GetSeconds() - now;
+        maxLag = std::max(maxLag, lag);
+        // more than a tick behind, what AirSim sees is already stale
+        if(lag > updateGranularity){
+            NS_LOG_WARN("time: " << now << " realtime lag= " << lag * 1000 << " ms, max= " << maxLag * 1000 << " ms");
+        }
+        else{
+            NS_LOG_INFO("time: " << now << " realtime lag= " << lag * 1000 << " ms, max= " << maxLag * 1000 << " ms");
+        }
+    }
+    Simulator::Schedule(interval, &AirSimSync::reportLag, this, interval);
+}
+// no ticks in realtime mode, net state, flow and latency samples every updateGranularity
+void AirSimSync::realtimeSample(Ptr<GcsApp> gcsApp, std::vector< Ptr<UavApp> > uavsApp)
+{
+    if(netState){
+        zmq::message_t frame = netState->frame(tick, gcsApp, uavsApp);
+        zmqSendSocket.send(frame, zmq::send_flags::dontwait);
+    }
+    if(flowStats){
+        flowStats->sample(tick);
+    }
+    if(msgLatency){
+        msgLatency->sample(tick);
+    }
+    tick++;
+    Simulator::Schedule(Seconds(updateGranularity), &AirSimSync::realtimeSample, this, gcsApp, uavsApp);
 }
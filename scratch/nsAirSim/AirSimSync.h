@@ -3,6 +3,10 @@
 // std includes
 #include <vector>
 #include <string>
+#include <chrono>
+#include <thread>
+#include <atomic>
+#include <memory>
 // ns3 includes
 #include "ns3/core-module.h"
 #include "ns3/network-module.h"
@@ -10,22 +14,36 @@
 #include "ns3/point-to-point-module.h"
 #include "ns3/applications-module.h"
 #include "ns3/stats-module.h"
+#include "ns3/mobility-module.h"
 // zmq includes
 #include <zmq.hpp>
 // custom includes
 #include "gcsApp.h"
 #include "uavApp.h"
+#include "wireFormat.h"
+#include "airSimMobilityModel.h"
+#include "zmqMux.h"
+#include "sessionLog.h"
+#include "tickProfiler.h"
+#include "netStateMonitor.h"
+#include "flowStats.h"
+#include "msgLatency.h"
+#include "logHistogram.h"
 // externs
 extern zmq::context_t context;
 
 
-#define NS2AIRSIM_PORT_START (5000)
-#define AIRSIM2NS_PORT_START (6000)
+// shared by all UAVs, see ZmqMux
+#define NS2AIRSIM_UAV_PORT (5000)
+#define AIRSIM2NS_UAV_PORT (6000)
 #define NS2AIRSIM_GCS_PORT (4999)
 #define AIRSIM2NS_GCS_PORT (4998)
 
 #define UAV_PORT_START (3000)
 #define GCS_PORT_START (4000)
+#define UAV_UDP_PORT (UAV_PORT_START + 100) // messages of UDP classes, see NetConfig::udpClasses
+#define GCS_UDP_PORT (GCS_PORT_START + 1)
+#define UDP_IP_OVERHEAD (28) // IPv4 and UDP headers of a datagram
 #define CONG_PORT_START (UAV_PORT_START)
 
 #define NS2AIRSIM_CTRL_PORT (8000)
@@ -37,50 +55,131 @@ extern zmq::context_t context;
 
 #define CLEAN_UP_TIME (1.0)
 
+// realtime I/O thread wakes up at least this often to notice stopRealtime
+#define REALTIME_POLL_TIMEOUT_MS (10)
+
 using namespace std;
 
+/*
+* Sent by AirSim as either
+* - a msgpack map keyed by the field names below plus "version", fields left
+*   out keep these defaults except uavsName and initEnbApPos, or
+* - the legacy whitespace separated text blob, every field by position.
+* Both are validated the same way.
+*/
 struct NetConfig
 {
-    float updateGranularity;
-    int segmentSize;
-    int numOfCong;
-    float congRate;
-    float congX, congY, congRho;
+    float updateGranularity = 0.01;
+    int segmentSize = 1448;
+    int numOfCong = 0;
+    float congRate = 0;
+    float congX = 0, congY = 0, congRho = 50;
     std::vector<string> uavsName;
     std::vector< std::vector<float> > initEnbApPos;
     
-    int nRbs; // see https://i.imgur.com/q55uR8T.png
-    uint TcpSndBufSize; // was 429496729
-    uint TcpRcvBufSize; // was 429496729
-    uint CqiTimerThreshold;
-    double LteTxPower;
+    int nRbs = 25; // see https://i.imgur.com/q55uR8T.png
+    uint TcpSndBufSize = 429496729; // was 429496729
+    uint TcpRcvBufSize = 429496729; // was 429496729
+    uint CqiTimerThreshold = 10;
+    double LteTxPower = 30;
     std::string p2pDataRate = "10Gb/s";
-    uint p2pMtu;
-    double p2pDelay;
-    int useWifi;
+    uint p2pMtu = 1500;
+    double p2pDelay = 0.001;
+    int useWifi = 0;
     
-    int isMainLogEnabled;
-    int isGcsLogEnabled;
-    int isUavLogEnabled;
-    int isCongLogEnabled;
-    int isSyncLogEnabled;
+    int isMainLogEnabled = 0;
+    int isGcsLogEnabled = 0;
+    int isUavLogEnabled = 0;
+    int isCongLogEnabled = 0;
+    int isSyncLogEnabled = 0;
 
+    // optional trailing fields of the text blob, older AirSim builds may not send them
+    int usePoseStream = 0; // AirSim pushes a PoseFrame per tick instead of being polled by RPC
+    int asyncAck = 0; // one batched AckHeader frame per drain instead of a reply per message
+    int lookahead = 0; // ticks AirSim may run ahead of ns, 0 is strict lockstep
+    float maxGranularity = 0; // longest tick when the network is idle, updateGranularity is the shortest
+    int netState = 0; // a NetStateHeader frame per tick right before the grant
+    uint32_t udpClasses = 0; // bit n set sends messages of MsgHeader::msgClass n over UDP, the others over TCP
 };
 
 class AirSimSync
 {
 public:
-    AirSimSync(zmq::context_t &context);
+    // sessionLog records or replaces everything received from AirSim if set
+    AirSimSync(zmq::context_t &context, SessionLog *sessionLog = nullptr);
     ~AirSimSync();
-    void readNetConfigFromAirSim(NetConfig &config);
+    // from AirSim, or from a file in either format if path is set
+    void readNetConfig(NetConfig &config, const std::string &path = "");
     void startAirSim();
+    // indexed by vehicle id, i.e. the order of NetConfig::uavsName
+    void setUavsMobility(std::vector< Ptr<AirSimMobilityModel> > uavsMobility);
+    void setUavMux(ZmqMux *uavMux);
+    void setGcsMux(ZmqMux *gcsMux);
+    void setProfiler(TickProfiler *profiler);
+    // net state frames are sent only if set
+    void setNetStateMonitor(NetStateMonitor *netState);
+    // sampled at the end of every tick if set
+    void setFlowStats(FlowStats *flowStats);
+    void setMsgLatency(MsgLatency *msgLatency);
     void takeTurn(Ptr<GcsApp> &gcsApp, std::vector< Ptr<UavApp> > &uavsApp);
+    /*
+    * Realtime mode, instead of takeTurn. Runs under RealtimeSimulatorImpl,
+    * an I/O thread injects AirSim's messages as they arrive and nothing is
+    * acknowledged, so AirSim never blocks on ns. Lag behind the wall clock is
+    * printed every lagInterval.
+    */
+    void startRealtime(Ptr<GcsApp> &gcsApp, std::vector< Ptr<UavApp> > &uavsApp, Time lagInterval);
+    void stopRealtime(void);
+    // wall time spent in every takeTurn so far, in microseconds
+    const LogHistogram& getTurnWallTimes(void) const {return turnWallTimes;}
 private:
+    // blocking receive on the control channel, recorded or replayed as logType
+    zmq::recv_result_t recvControl(zmq::message_t &message, uint16_t logType);
+    // return false if message is not a pose frame
+    bool applyPoseFrame(const zmq::message_t &message);
+    // allow AirSim to finish every tick up to tick, suggesting its length
+    void grant(uint32_t tick, float step);
+    // next tick length from the network activity seen since the last call
+    float suggestStep(Ptr<GcsApp> &gcsApp, std::vector< Ptr<UavApp> > &uavsApp);
+
+    // realtime mode, the I/O thread only touches the receiving sockets
+    void ioLoop(GcsApp *gcsApp, std::vector<UavApp*> uavsApp);
+    // events scheduled by the I/O thread, run by the simulator thread
+    static void deliverToUav(UavApp *app, std::shared_ptr<zmq::message_t> message, uint8_t msgClass);
+    static void deliverToGcs(GcsApp *app, uint16_t vehicleId, std::shared_ptr<zmq::message_t> message, uint8_t msgClass);
+    void deliverPoses(std::shared_ptr<zmq::message_t> message);
+    void realtimeMobility(GcsApp *gcsApp);
+    void reportLag(Time interval);
+    void realtimeSample(Ptr<GcsApp> gcsApp, std::vector< Ptr<UavApp> > uavsApp);
+
     zmq::socket_t zmqRecvSocket, zmqSendSocket;
     float updateGranularity;
+    uint32_t lookahead = 0;
+    float maxGranularity = 0;
+    float step = 0; // last suggested
+    uint64_t lastTxBytes = 0;
     EventId event;
     bool waitOnAirSim = true;
+
+    ZmqMux *uavMux = nullptr;
+    ZmqMux *gcsMux = nullptr;
+    std::thread ioThread;
+    std::atomic<bool> ioStop;
+    double maxLag = 0.0; // s
+    SessionLog *sessionLog;
+    TickProfiler *profiler = nullptr;
+    NetStateMonitor *netState = nullptr;
+    FlowStats *flowStats = nullptr;
+    MsgLatency *msgLatency = nullptr;
+    uint32_t tick = 0;
+    LogHistogram turnWallTimes; // us, a fixed size however long the run
+    std::vector< Ptr<AirSimMobilityModel> > uavsMobility;
+    std::vector<Vector> lastPos; // base of delta encoded pose frames
 };
+// false if data is not msgpack, i.e. the text blob
+bool decodeNetConfig(const void *data, std::size_t size, NetConfig &config);
+// fatal error on the first bad field
+void validateNetConfig(const NetConfig &config);
 std::istream& operator>>(istream & is, NetConfig &config);
 std::ostream& operator<<(ostream & os, const NetConfig &config);
 
@@ -0,0 +1,95 @@
+// std includes
+#include <algorithm>
+// ns3 includes
+#include "ns3/core-module.h"
+#include "ns3/mobility-module.h"
+// custom includes
+#include "airSimMobilityModel.h"
+
+using namespace std;
+using namespace ns3;
+
+NS_LOG_COMPONENT_DEFINE ("AirSimMobilityModel");
+NS_OBJECT_ENSURE_REGISTERED (AirSimMobilityModel); // looked up by name in MobilityHelper
+
+TypeId AirSimMobilityModel::GetTypeId(void)
+{
+    static TypeId tid = TypeId("AirSimMobilityModel")
+        .SetParent<MobilityModel>()
+        .SetGroupName("ns3_AirSim")
+        .AddConstructor<AirSimMobilityModel>()
+        .AddAttribute("MaxExtrapolation", "Stop extrapolating after this long without an update",
+            TimeValue(Seconds(1.0)),
+            MakeTimeAccessor(&AirSimMobilityModel::m_maxExtrapolation),
+            MakeTimeChecker())
+        .AddAttribute("UseAcceleration", "Extrapolate with the acceleration term as well",
+            BooleanValue(true),
+            MakeBooleanAccessor(&AirSimMobilityModel::m_useAcceleration),
+            MakeBooleanChecker())
+        .AddTraceSource("ExtrapolationError", "Distance (m) between the extrapolated and the reported position",
+            MakeTraceSourceAccessor(&AirSimMobilityModel::m_errorTrace),
+            "AirSimMobilityModel::ErrorCallback")
+    ;
+    return tid;
+}
+
+void AirSimMobilityModel::SetKinematics(const Vector &position, const Vector &velocity, const Vector &acceleration)
+{
+    if(m_hasKinematics){
+        double error = CalculateDistance(DoGetPosition(), position);
+        m_numOfErrors++;
+        m_errorSum += error;
+        m_errorMax = max(m_errorMax, error);
+        m_errorTrace(error);
+        NS_LOG_INFO("time: " << Simulator::Now().GetSeconds() << ", extrapolation error " << error << " m");
+    }
+    m_hasKinematics = true;
+    m_base = Simulator::Now();
+    m_position = position;
+    m_velocity = velocity;
+    m_acceleration = m_useAcceleration ? acceleration : Vector(0, 0, 0);
+    NotifyCourseChange();
+}
+double AirSimMobilityModel::GetMeanError(void) const
+{
+    return m_numOfErrors ? m_errorSum / m_numOfErrors : 0.0;
+}
+double AirSimMobilityModel::GetMaxError(void) const
+{
+    return m_errorMax;
+}
+
+double AirSimMobilityModel::elapsed(void) const
+{
+    return min(Simulator::Now() - m_base, m_maxExtrapolation).GetSeconds();
+}
+Vector AirSimMobilityModel::DoGetPosition(void) const
+{
+    double t = elapsed();
+    return Vector(
+        m_position.x + m_velocity.x*t + 0.5*m_acceleration.x*t*t,
+        m_position.y + m_velocity.y*t + 0.5*m_acceleration.y*t*t,
+        m_position.z + m_velocity.z*t + 0.5*m_acceleration.z*t*t
+    );
+}
+void AirSimMobilityModel::DoSetPosition(const Vector &position)
+{
+    // plain position (e.g. from a position allocator) means standing still
+    m_base = Simulator::Now();
+    m_position = position;
+    m_velocity = Vector(0, 0, 0);
+    m_acceleration = Vector(0, 0, 0);
+    NotifyCourseChange();
+}
+Vector AirSimMobilityModel::DoGetVelocity(void) const
+{
+    if(Simulator::Now() - m_base >= m_maxExtrapolation){
+        return Vector(0, 0, 0);
+    }
+    double t = elapsed();
+    return Vector(
+        m_velocity.x + m_acceleration.x*t,
+        m_velocity.y + m_acceleration.y*t,
+        m_velocity.z + m_acceleration.z*t
+    );
+}
@@ -0,0 +1,57 @@
+#ifndef INCLUDE_AIRSIMMOBILITYMODEL_H
+#define INCLUDE_AIRSIMMOBILITYMODEL_H
+
+// ns3 includes
+#include "ns3/core-module.h"
+#include "ns3/mobility-module.h"
+
+using namespace std;
+using namespace ns3;
+
+/*
+* Mobility driven by AirSim's ground truth kinematics.
+* Between two updates the position is extrapolated with the last velocity and
+* acceleration, so the channel sees a smooth trajectory even with a coarse
+* updateGranularity. Each update reports how far the extrapolation drifted.
+*/
+class AirSimMobilityModel: public MobilityModel
+{
+public:
+    AirSimMobilityModel() = default;
+    virtual ~AirSimMobilityModel() = default;
+
+    /**
+    * Register this type.
+    * \return The TypeId.
+    */
+    static TypeId GetTypeId(void);
+    typedef void (* ErrorCallback)(double error);
+
+    void SetKinematics(const Vector &position, const Vector &velocity, const Vector &acceleration);
+
+    // distance between the extrapolated and the reported position over all updates
+    double GetMeanError(void) const;
+    double GetMaxError(void) const;
+private:
+    virtual Vector DoGetPosition(void) const;
+    virtual void DoSetPosition(const Vector &position);
+    virtual Vector DoGetVelocity(void) const;
+
+    // seconds since the last update, capped by m_maxExtrapolation
+    double elapsed(void) const;
+
+    Time m_base;
+    Vector m_position;
+    Vector m_velocity;
+    Vector m_acceleration;
+    Time m_maxExtrapolation;
+    bool m_useAcceleration;
+
+    bool m_hasKinematics = false;
+    uint64_t m_numOfErrors = 0;
+    double m_errorSum = 0.0;
+    double m_errorMax = 0.0;
+    TracedCallback<double> m_errorTrace;
+};
+
+#endif
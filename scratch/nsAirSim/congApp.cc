@@ -1,5 +1,8 @@
 // std includes
-#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <cmath>
 // ns3 includes
 #include "ns3/core-module.h"
 #include "ns3/network-module.h"
@@ -9,15 +12,18 @@
 #include "ns3/stats-module.h"
 // custom includes
 #include "congApp.h"
+#include "msgFramer.h"
+#include "wireFormat.h"
+#include "traceLog.h"
 
 using namespace std;
 using namespace ns3;
 
 NS_LOG_COMPONENT_DEFINE ("CongApp");
 
-CongApp::CongApp(): m_event()
+CongApp::CongApp(): m_running(false), m_congRate(0), m_event()
 {
-    // Todo
+    m_gap = CreateObject<ExponentialRandomVariable>();
 }
 
 CongApp::~CongApp()
@@ -31,47 +37,92 @@ TypeId CongApp::GetTypeId(void)
         .SetParent<Application>()
         .SetGroupName("ns3_AirSim")
         .AddConstructor<CongApp>()
+        .AddAttribute("Arrival", "Arrival process of the packets",
+            EnumValue(CONG_ARRIVAL_POISSON),
+            MakeEnumAccessor(&CongApp::m_arrival),
+            MakeEnumChecker(CONG_ARRIVAL_POISSON, "poisson",
+                CONG_ARRIVAL_ONOFF, "onoff",
+                CONG_ARRIVAL_CBR, "cbr",
+                CONG_ARRIVAL_TRACE, "trace"))
+        .AddAttribute("Protocol", "Transport of the packets",
+            EnumValue(CONG_PROTOCOL_TCP),
+            MakeEnumAccessor(&CongApp::m_protocol),
+            MakeEnumChecker(CONG_PROTOCOL_TCP, "tcp",
+                CONG_PROTOCOL_UDP, "udp"))
+        .AddAttribute("Size", "Bytes per packet, clamped to [1, 65000]",
+            StringValue("ns3::ConstantRandomVariable[Constant=5120]"),
+            MakePointerAccessor(&CongApp::m_size),
+            MakePointerChecker<RandomVariableStream>())
+        .AddAttribute("OnTime", "Seconds of an on period, onoff only",
+            StringValue("ns3::ExponentialRandomVariable[Mean=1.0]"),
+            MakePointerAccessor(&CongApp::m_onTime),
+            MakePointerChecker<RandomVariableStream>())
+        .AddAttribute("OffTime", "Seconds of an off period, onoff only",
+            StringValue("ns3::ExponentialRandomVariable[Mean=1.0]"),
+            MakePointerAccessor(&CongApp::m_offTime),
+            MakePointerChecker<RandomVariableStream>())
+        .AddAttribute("TraceFile", "One '<seconds since start> <bytes>' line per packet, replayed in a loop, trace only",
+            StringValue(""),
+            MakeStringAccessor(&CongApp::m_tracePath),
+            MakeStringChecker())
     ;
     return tid;
 }
 
-/* Init ns stuff, rPC client connection and zmq socket init, connect */
-void CongApp::Setup(Ptr<Socket> socket, Address myAddress, Address peerAddress,
-    float congRate, std::string name
-)
+void CongApp::Setup(Address tcpPeerAddress, Address udpPeerAddress, float congRate, std::string name)
 {
-    m_socket = socket;
-    m_address = myAddress;
-    m_peerAddress = peerAddress;
+    m_peerAddress = tcpPeerAddress;
+    m_udpPeerAddress = udpPeerAddress;
     m_congRate = congRate;
     m_name = name;
+    if(m_congRate > 0){
+        m_gap->SetAttribute("Mean", DoubleValue(1.0 / m_congRate));
+    }
+}
+
+int64_t CongApp::AssignStreams(int64_t stream)
+{
+    m_size->SetStream(stream);
+    m_onTime->SetStream(stream + 1);
+    m_offTime->SetStream(stream + 2);
+    m_gap->SetStream(stream + 3);
+    return CONG_STREAMS;
 }
 
-/* Bind ns sockets and logging*/
+/* Create and connect the socket, then start the arrival process */
 void CongApp::StartApplication(void)
 {
-    m_running = true;
+    bool udp = (m_protocol == CONG_PROTOCOL_UDP);
 
-    // ns socket routines
+    m_socket = Socket::CreateSocket(GetNode(), udp ? UdpSocketFactory::GetTypeId() : TcpSocketFactory::GetTypeId());
     m_socket->Bind();
-    if(m_socket->Connect(m_peerAddress) != 0){
+    if(m_socket->Connect(udp ? m_udpPeerAddress : m_peerAddress) != 0){
         NS_FATAL_ERROR("Cong connect error");
     };
-    
+
     m_socket->SetRecvCallback(
         MakeCallback(&CongApp::recvCallback, this)
     );
 
-    // send my name
-    std::string s = "name " + m_name + " ";
-    Ptr<Packet> packet = Create<Packet>((const uint8_t*)(s.c_str()), s.size()+1);
-    if(m_socket->Send(packet) == -1){
-        NS_FATAL_ERROR(m_name << " sends my name Error");
+    // send my name, the GCS takes it for another peer
+    if(!udp){
+        Ptr<Packet> packet = Create<Packet>((const uint8_t*)(m_name.c_str()), m_name.size());
+        if(m_socket->Send(MsgFramer::frame(packet, FRAME_HELLO)) == -1){
+            NS_FATAL_ERROR(m_name << " sends my name Error");
+        }
     }
 
-    m_running = true;
-    NS_LOG_INFO("[" << m_name << " starts]");
+    if(m_arrival == CONG_ARRIVAL_TRACE){
+        loadTrace();
+        m_traceIndex = 0;
+        m_traceBase = Simulator::Now();
+    }
+    else if(!(m_congRate > 0)){
+        NS_LOG_WARN("[" << m_name << "] congRate is " << m_congRate << ", no congestion traffic");
+    }
+    m_onUntil = Simulator::Now() + Seconds(max(0.0, m_onTime->GetValue()));
 
+    m_running = true;
     scheduleTx();
     NS_LOG_INFO("[Cong " << m_name << " starts]");
 }
@@ -88,37 +139,124 @@ void CongApp::StopApplication(void)
 
     NS_LOG_INFO("[Cong " << m_name << " stopped]");
 }
-void CongApp::Tx(Ptr<Socket> socket, Ptr<Packet> packet)
+void CongApp::Tx(void)
 {
     float now = Simulator::Now().GetSeconds();
-    int res = socket->Send(packet);
+    Ptr<Packet> packet = Create<Packet>(m_nextSize);
+    if(m_protocol == CONG_PROTOCOL_TCP){
+        packet = MsgFramer::frame(packet, FRAME_DATA);
+    }
+    uint32_t size = packet->GetSize();
+    int res = m_socket->Send(packet);
 
+    TraceLog::trace(TRACE_CONG_SEND, GetNode()->GetId(), MSG_NO_VEHICLE, size, res);
     if(res < 0){
         NS_LOG_WARN("time: " << now << ", [" << m_name << " send] ERROR " << res);
     }
-    else{
-        NS_LOG_INFO("time: " << now << ", [" << m_name << " send]");
-    }
+    scheduleTx();
 }
 void CongApp::scheduleTx(void)
 {
-    // r [0, 1]
-    float r = static_cast <float> (rand()) / static_cast <float> (RAND_MAX);
-    r = rand() % 2 ? r : -r;
+    Time delay;
+    uint32_t size;
 
-    Ptr<Packet> packet = Create<Packet>(CONG_PACKET_SIZE);
+    if(!m_running || !nextPacket(delay, size)){
+        return;
+    }
+    m_nextSize = size;
+    m_event = Simulator::Schedule(delay, &CongApp::Tx, this);
+}
+bool CongApp::nextPacket(Time &delay, uint32_t &size)
+{
+    Time now = Simulator::Now();
 
-    Time tNext(Seconds(max((float)1e-3, 1/m_congRate + r)));
-    m_event = Simulator::Schedule(tNext, &CongApp::Tx, this, m_socket, packet);
+    if(m_arrival == CONG_ARRIVAL_TRACE){
+        if(m_trace.empty()){
+            return false;
+        }
+        if(m_traceIndex == m_trace.size()){
+            // a trace without duration would loop in place
+            if(!m_trace.back().first.IsStrictlyPositive()){
+                return false;
+            }
+            m_traceBase += m_trace.back().first;
+            m_traceIndex = 0;
+        }
+        Time at = m_traceBase + m_trace[m_traceIndex].first;
+        size = m_trace[m_traceIndex].second;
+        m_traceIndex++;
+        delay = max(at - now, Seconds(0));
+        return true;
+    }
+
+    if(!(m_congRate > 0)){
+        return false;
+    }
+    double gap = 1.0 / m_congRate;
+    size = std::min(std::max(1.0, std::round(m_size->GetValue())), (double)CONG_MAX_PACKET_SIZE);
+
+    switch(m_arrival){
+    case CONG_ARRIVAL_POISSON:
+        delay = Seconds(m_gap->GetValue());
+        break;
+    case CONG_ARRIVAL_CBR:
+        delay = Seconds(gap);
+        break;
+    case CONG_ARRIVAL_ONOFF:
+    {
+        Time at = now + Seconds(gap);
+        // past the on period, the next one starts after an off period
+        while(at > m_onUntil){
+            at = m_onUntil + Seconds(max(0.0, m_offTime->GetValue()));
+            m_onUntil = at + Seconds(max(0.0, m_onTime->GetValue()));
+        }
+        delay = at - now;
+        break;
+    }
+    default:
+        return false;
+    }
+    return true;
+}
+/* <seconds since start> <bytes>, '#' starts a comment */
+void CongApp::loadTrace(void)
+{
+    std::ifstream file(m_tracePath);
+    std::string line;
+    std::size_t lineNo = 0;
+
+    if(!file){
+        NS_FATAL_ERROR("[" << m_name << "] cannot read the congestion trace '" << m_tracePath << "'");
+    }
+    m_trace.clear();
+    while(std::getline(file, line)){
+        lineNo++;
+        line = line.substr(0, line.find('#'));
+        if(line.find_first_not_of(" \t\r") == std::string::npos){
+            continue;
+        }
+        std::istringstream ss(line);
+        double seconds;
+        double bytes;
+        if(!(ss >> seconds >> bytes) || seconds < 0 || bytes < 1){
+            NS_FATAL_ERROR(m_tracePath << ":" << lineNo << ": expected '<seconds> <bytes>'");
+        }
+        if(!m_trace.empty() && Seconds(seconds) < m_trace.back().first){
+            NS_FATAL_ERROR(m_tracePath << ":" << lineNo << ": times must not go back");
+        }
+        m_trace.push_back(std::make_pair(Seconds(seconds), (uint32_t)std::min(bytes, (double)CONG_MAX_PACKET_SIZE)));
+    }
+    if(m_trace.empty()){
+        NS_LOG_WARN("[" << m_name << "] congestion trace " << m_tracePath << " is empty");
+    }
 }
 /* <from-address> <payload> then forward to application code */
 void CongApp::recvCallback(Ptr<Socket> socket)
 {
-    float now = Simulator::Now().GetSeconds();
     Ptr<Packet> packet;
     Address from;
 
-    packet = socket->RecvFrom(from);
-
-    NS_LOG_INFO("time: " << now << ", [" << m_name << " recv]");
-}
\ No newline at end of file
+    while((packet = socket->RecvFrom(from))){
+        TraceLog::trace(TRACE_CONG_RECV, GetNode()->GetId(), MSG_NO_VEHICLE, packet->GetSize());
+    }
+}
@@ -1,6 +1,9 @@
 #ifndef INCLUDE_CONGAPP_H
 #define INCLUDE_CONGAPP_H
 
+// std includes
+#include <vector>
+#include <string>
 // ns3 includes
 #include "ns3/core-module.h"
 #include "ns3/network-module.h"
@@ -9,11 +12,34 @@
 #include "ns3/applications-module.h"
 #include "ns3/stats-module.h"
 
-#define CONG_PACKET_SIZE (1024*5)
+#define CONG_PACKET_SIZE (1024*5) // default of the Size attribute
+#define CONG_MAX_PACKET_SIZE (65000) // fits a UDP datagram
+#define CONG_UDP_PORT (4100) // packet sink on the GCS node for UDP congestion
+#define CONG_STREAMS (4) // random variable streams used by one CongApp
 
 using namespace std;
 using namespace ns3;
 
+enum CongArrival
+{
+    CONG_ARRIVAL_POISSON = 0, // exponential gaps, mean 1/congRate
+    CONG_ARRIVAL_ONOFF, // CBR at congRate during OnTime, silent during OffTime
+    CONG_ARRIVAL_CBR, // one packet every 1/congRate
+    CONG_ARRIVAL_TRACE // times and sizes from TraceFile
+};
+enum CongProtocol
+{
+    CONG_PROTOCOL_TCP = 0, // framed like a UAV, shows up at the GCS as a peer
+    CONG_PROTOCOL_UDP // raw datagrams to the sink on CONG_UDP_PORT
+};
+
+/*
+* Background load on the cell for the whole run. The arrival process, packet
+* sizes and transport are attributes, e.g.
+* --CongApp::Arrival=onoff --CongApp::Size=ns3::NormalRandomVariable[Mean=1200|Variance=40000]
+* Draws come from ns-3 random variable streams, fixed with AssignStreams and
+* --RngRun, so runs repeat exactly.
+*/
 class CongApp: public Application
 {
 public:
@@ -25,27 +51,45 @@ public:
     * \return The TypeId.
     */
     static TypeId GetTypeId(void);
-    void Setup(Ptr<Socket> socket, Address myAddress, Address peerAddress,
-        float congRate, std::string name
-    );
+    // congRate is in packets per second, tcpPeer/udpPeer is the GCS for either protocol
+    void Setup(Address tcpPeerAddress, Address udpPeerAddress, float congRate, std::string name);
+    // returns the number of streams used, CONG_STREAMS
+    int64_t AssignStreams(int64_t stream);
 
     void scheduleTx(void);
 private:
     virtual void StartApplication (void);
     virtual void StopApplication (void);
 
-    void Tx(Ptr<Socket> socket, Ptr<Packet> packet);
+    void Tx(void);
+    // time to the next packet and its size, false when there is none
+    bool nextPacket(Time &delay, uint32_t &size);
+    void loadTrace(void);
 
     void recvCallback(Ptr<Socket> socket);
 
     bool m_running;
     std::string m_name;
     float m_congRate;
+    // attributes
+    CongArrival m_arrival;
+    CongProtocol m_protocol;
+    Ptr<RandomVariableStream> m_size;
+    Ptr<RandomVariableStream> m_onTime;
+    Ptr<RandomVariableStream> m_offTime;
+    std::string m_tracePath;
+    // arrival state
+    Ptr<ExponentialRandomVariable> m_gap;
+    Time m_onUntil; // end of the current on period
+    uint32_t m_nextSize = 0;
+    std::vector< std::pair<Time, uint32_t> > m_trace; // since the start, bytes
+    std::size_t m_traceIndex = 0;
+    Time m_traceBase; // start of the current pass over the trace
     // ns stuff
     Ptr<Socket>     m_socket;
-    Address         m_address;
     Address         m_peerAddress;
+    Address         m_udpPeerAddress;
     EventId         m_event;
 };
 
-#endif
\ No newline at end of file
+#endif
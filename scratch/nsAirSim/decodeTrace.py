@@ -0,0 +1,90 @@
+#!/usr/bin/env python3
+# Decoder of the binary per-packet trace written by nsAirSim --trace=<file>,
+# see traceLog.h for the format.
+#
+#   python3 scratch/nsAirSim/decodeTrace.py trace.bin                 # one line per record
+#   python3 scratch/nsAirSim/decodeTrace.py trace.bin --csv           # CSV
+#   python3 scratch/nsAirSim/decodeTrace.py trace.bin --summary       # totals per node and event
+#   python3 scratch/nsAirSim/decodeTrace.py trace.bin --type UAV_SEND --node 3
+
+from __future__ import print_function
+import argparse
+import collections
+import struct
+import sys
+
+MAGIC = b'NSASTRC1'
+# TraceRecord: timeNs tick nodeId bytes result type peer reserved
+RECORD = struct.Struct('<qIIIiHHI')
+NO_VEHICLE = 0xFFFF
+
+# keep in sync with traceLog.h
+TYPES = {
+    1: 'GCS_ACCEPT',
+    2: 'GCS_AUTH',
+    3: 'GCS_SEND',
+    4: 'GCS_RECV',
+    5: 'UAV_SEND',
+    6: 'UAV_RECV',
+    7: 'CONG_SEND',
+    8: 'CONG_RECV',
+}
+
+
+def records(f):
+    header = f.read(16)
+    if len(header) < 16 or header[:8] != MAGIC:
+        sys.exit('not a nsAirSim trace')
+    size, = struct.unpack_from('<I', header, 8)
+    if size < RECORD.size:
+        sys.exit('record size %d, expected at least %d' % (size, RECORD.size))
+    while True:
+        data = f.read(size)
+        if len(data) < size:
+            return
+        yield RECORD.unpack_from(data)
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Decode a nsAirSim binary trace')
+    parser.add_argument('trace')
+    parser.add_argument('--csv', action='store_true', help='print CSV')
+    parser.add_argument('--summary', action='store_true', help='print totals per node and event type only')
+    parser.add_argument('--type', action='append', help='keep only this event type, e.g. UAV_SEND')
+    parser.add_argument('--node', type=int, action='append', help='keep only this node id')
+    args = parser.parse_args()
+
+    types = set(t.upper() for t in args.type) if args.type else None
+    nodes = set(args.node) if args.node else None
+    totals = collections.defaultdict(lambda: [0, 0, 0])  # records, bytes, errors
+
+    if args.csv and not args.summary:
+        print('time,tick,node,type,peer,bytes,result')
+    with open(args.trace, 'rb') as f:
+        for timeNs, tick, nodeId, size, result, type_, peer, _ in records(f):
+            name = TYPES.get(type_, str(type_))
+            if types is not None and name not in types:
+                continue
+            if nodes is not None and nodeId not in nodes:
+                continue
+            if args.summary:
+                total = totals[(nodeId, name)]
+                total[0] += 1
+                total[1] += size
+                total[2] += result < 0
+                continue
+            peerText = '' if peer == NO_VEHICLE else str(peer)
+            if args.csv:
+                print('%.9f,%d,%d,%s,%s,%d,%d' % (timeNs * 1e-9, tick, nodeId, name, peerText, size, result))
+            else:
+                print('time: %.9f tick: %d node: %d %s peer: %s %d bytes result: %d' % (timeNs * 1e-9, tick, nodeId, name, peerText or '-', size, result))
+
+    if args.summary:
+        print('%6s %-10s %10s %14s %8s' % ('node', 'type', 'records', 'bytes', 'errors'))
+        for (nodeId, name), (count, size, errors) in sorted(totals.items()):
+            print('%6d %-10s %10d %14d %8d' % (nodeId, name, count, size, errors))
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
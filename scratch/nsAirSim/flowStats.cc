@@ -0,0 +1,239 @@
+// std includes
+#include <cstdlib>
+#include <algorithm>
+// ns3 includes
+#include "ns3/core-module.h"
+#include "ns3/network-module.h"
+#include "ns3/internet-module.h"
+// custom includes
+#include "flowStats.h"
+
+using namespace std;
+using namespace ns3;
+
+NS_LOG_COMPONENT_DEFINE ("FlowStats");
+NS_OBJECT_ENSURE_REGISTERED (FlowStatsTag);
+
+#define FLOW_STATS_BUFFER (1 << 20) // bytes of sample rows buffered before a write
+
+const char *flowDirectionNames[FLOW_DIRECTIONS] = {"up", "down"};
+
+FlowStatsTag::FlowStatsTag(): m_vehicleId(0), m_direction(0), m_txTimeNs(0)
+{
+}
+FlowStatsTag::FlowStatsTag(uint16_t vehicleId, uint8_t direction, int64_t txTimeNs):
+    m_vehicleId(vehicleId), m_direction(direction), m_txTimeNs(txTimeNs)
+{
+}
+TypeId FlowStatsTag::GetTypeId(void)
+{
+    static TypeId tid = TypeId("FlowStatsTag")
+        .SetParent<Tag>()
+        .SetGroupName("ns3_AirSim")
+        .AddConstructor<FlowStatsTag>()
+    ;
+    return tid;
+}
+TypeId FlowStatsTag::GetInstanceTypeId(void) const
+{
+    return GetTypeId();
+}
+uint32_t FlowStatsTag::GetSerializedSize(void) const
+{
+    return sizeof(m_vehicleId) + sizeof(m_direction) + sizeof(m_txTimeNs);
+}
+void FlowStatsTag::Serialize(TagBuffer i) const
+{
+    i.WriteU16(m_vehicleId);
+    i.WriteU8(m_direction);
+    i.WriteU64(m_txTimeNs);
+}
+void FlowStatsTag::Deserialize(TagBuffer i)
+{
+    m_vehicleId = i.ReadU16();
+    m_direction = i.ReadU8();
+    m_txTimeNs = i.ReadU64();
+}
+void FlowStatsTag::Print(std::ostream &os) const
+{
+    os << "vehicleId=" << m_vehicleId << " direction=" << (int)m_direction << " txTimeNs=" << m_txTimeNs;
+}
+
+FlowStats::FlowStats(std::size_t numOfUav)
+{
+    m_flows = std::vector<Flow>(numOfUav * FLOW_DIRECTIONS);
+}
+FlowStats::~FlowStats()
+{
+    if(m_samples){
+        fclose(m_samples);
+    }
+}
+
+void FlowStats::watchGcs(Ptr<Node> gcsNode, Ipv4Address gcsAddress)
+{
+    m_gcsAddress = gcsAddress;
+    m_watched.emplace_back(new Watched{this, 0});
+    connect(gcsNode, m_watched.back().get(), true);
+}
+void FlowStats::watchUav(uint16_t vehicleId, Ptr<Node> uavNode, Ipv4Address uavAddress)
+{
+    m_uavAddresses[uavAddress] = vehicleId;
+    m_watched.emplace_back(new Watched{this, vehicleId});
+    connect(uavNode, m_watched.back().get(), false);
+}
+void FlowStats::connect(Ptr<Node> node, Watched *watched, bool gcs)
+{
+    Ptr<Ipv4L3Protocol> ipv4 = node->GetObject<Ipv4L3Protocol>();
+    if(!ipv4){
+        NS_FATAL_ERROR("[FlowStats] node " << node->GetId() << " has no IPv4 stack");
+    }
+    ipv4->TraceConnectWithoutContext("SendOutgoing", MakeBoundCallback(gcs ? &FlowStats::gcsSend : &FlowStats::uavSend, watched));
+    ipv4->TraceConnectWithoutContext("LocalDeliver", MakeBoundCallback(&FlowStats::localDeliver, watched));
+}
+
+void FlowStats::openSamples(const std::string &path)
+{
+    m_samples = fopen(path.c_str(), "w");
+    if(!m_samples){
+        NS_FATAL_ERROR("[FlowStats] cannot create " << path);
+    }
+    setvbuf(m_samples, nullptr, _IOFBF, FLOW_STATS_BUFFER);
+    fprintf(m_samples, "tick,simTime,vehicleId,direction,txPackets,rxPackets,txBytes,rxBytes,throughputMbps,delayMeanMs,delayMaxMs,jitterMeanMs\n");
+    m_lastSample = Simulator::Now();
+}
+
+void FlowStats::gcsSend(Watched *watched, const Ipv4Header &header, Ptr<const Packet> packet, uint32_t interface)
+{
+    FlowStats *stats = watched->stats;
+    auto uav = stats->m_uavAddresses.find(header.GetDestination());
+
+    if(uav != stats->m_uavAddresses.end()){
+        stats->send(uav->second, FLOW_DOWN, packet);
+    }
+}
+void FlowStats::uavSend(Watched *watched, const Ipv4Header &header, Ptr<const Packet> packet, uint32_t interface)
+{
+    if(header.GetDestination() == watched->stats->m_gcsAddress){
+        watched->stats->send(watched->vehicleId, FLOW_UP, packet);
+    }
+}
+void FlowStats::send(uint16_t vehicleId, FlowDirection direction, Ptr<const Packet> packet)
+{
+    Flow &flow = m_flows[vehicleId * FLOW_DIRECTIONS + direction];
+
+    packet->AddByteTag(FlowStatsTag(vehicleId, direction, Simulator::Now().GetNanoSeconds()));
+    flow.txPackets++;
+    flow.txBytes += packet->GetSize();
+    flow.txPacketsSample++;
+    flow.txBytesSample += packet->GetSize();
+}
+void FlowStats::localDeliver(Watched *watched, const Ipv4Header &header, Ptr<const Packet> packet, uint32_t interface)
+{
+    FlowStatsTag tag;
+
+    if(!packet->FindFirstMatchingByteTag(tag)){
+        return;
+    }
+    Flow &flow = watched->stats->m_flows[tag.GetVehicleId() * FLOW_DIRECTIONS + tag.GetDirection()];
+    Time now = Simulator::Now();
+    int64_t delayNs = now.GetNanoSeconds() - tag.GetTxTimeNs();
+
+    if(flow.rxPackets == 0){
+        flow.firstRx = now;
+    }
+    flow.lastRx = now;
+    flow.rxPackets++;
+    flow.rxBytes += packet->GetSize();
+    flow.delayUs.add(delayNs / 1000);
+    flow.rxPacketsSample++;
+    flow.rxBytesSample += packet->GetSize();
+    flow.delayNsSample += delayNs;
+    flow.delayMaxNsSample = std::max(flow.delayMaxNsSample, delayNs);
+    // RFC 3550 style, without the smoothing
+    if(flow.lastDelayNs >= 0){
+        int64_t jitterNs = std::llabs(delayNs - flow.lastDelayNs);
+        flow.jitterNs += jitterNs;
+        flow.jitters++;
+        flow.jitterNsSample += jitterNs;
+        flow.jittersSample++;
+    }
+    flow.lastDelayNs = delayNs;
+}
+
+void FlowStats::sample(uint32_t tick)
+{
+    Time now = Simulator::Now();
+    double interval = (now - m_lastSample).GetSeconds();
+
+    for(std::size_t i = 0; i < m_flows.size(); i++){
+        Flow &flow = m_flows[i];
+        if(flow.txPacketsSample == 0 && flow.rxPacketsSample == 0){
+            continue;
+        }
+        if(m_samples){
+            double rxPackets = std::max<uint64_t>(flow.rxPacketsSample, 1);
+            fprintf(m_samples, "%u,%.6f,%zu,%s,%llu,%llu,%llu,%llu,%.6f,%.3f,%.3f,%.3f\n",
+                tick, now.GetSeconds(), i / FLOW_DIRECTIONS, flowDirectionNames[i % FLOW_DIRECTIONS],
+                (unsigned long long)flow.txPacketsSample, (unsigned long long)flow.rxPacketsSample,
+                (unsigned long long)flow.txBytesSample, (unsigned long long)flow.rxBytesSample,
+                interval > 0 ? flow.rxBytesSample * 8.0 / interval / 1e6 : 0.0,
+                flow.delayNsSample / rxPackets / 1e6, flow.delayMaxNsSample / 1e6,
+                flow.jittersSample ? (double)flow.jitterNsSample / flow.jittersSample / 1e6 : 0.0);
+        }
+        flow.txPacketsSample = 0;
+        flow.rxPacketsSample = 0;
+        flow.txBytesSample = 0;
+        flow.rxBytesSample = 0;
+        flow.delayNsSample = 0;
+        flow.delayMaxNsSample = 0;
+        flow.jitterNsSample = 0;
+        flow.jittersSample = 0;
+    }
+    m_lastSample = now;
+}
+
+/* throughput is over the receiving span, 0 with fewer than two packets */
+void FlowStats::writeSummary(const std::string &path, const std::vector<std::string> &names)
+{
+    FILE *file = fopen(path.c_str(), "w");
+    if(!file){
+        NS_FATAL_ERROR("[FlowStats] cannot create " << path);
+    }
+    fprintf(file, "vehicleId,name,direction,txPackets,rxPackets,lostPackets,txBytes,rxBytes,throughputMbps,"
+        "delayMinMs,delayMeanMs,delayP50Ms,delayP95Ms,delayP99Ms,delayMaxMs,jitterMeanMs\n");
+    for(std::size_t i = 0; i < m_flows.size(); i++){
+        const Flow &flow = m_flows[i];
+        std::size_t vehicleId = i / FLOW_DIRECTIONS;
+        double span = (flow.lastRx - flow.firstRx).GetSeconds();
+        const LogHistogram &delay = flow.delayUs;
+
+        fprintf(file, "%zu,%s,%s,%llu,%llu,%llu,%llu,%llu,%.6f,%.3f,%.3f,%.3f,%.3f,%.3f,%.3f,%.3f\n",
+            vehicleId, vehicleId < names.size() ? names[vehicleId].c_str() : "", flowDirectionNames[i % FLOW_DIRECTIONS],
+            (unsigned long long)flow.txPackets, (unsigned long long)flow.rxPackets,
+            (unsigned long long)(flow.txPackets - std::min(flow.rxPackets, flow.txPackets)),
+            (unsigned long long)flow.txBytes, (unsigned long long)flow.rxBytes,
+            span > 0 ? flow.rxBytes * 8.0 / span / 1e6 : 0.0,
+            delay.getMin() / 1e3, delay.getMean() / 1e3, delay.getPercentile(50) / 1e3,
+            delay.getPercentile(95) / 1e3, delay.getPercentile(99) / 1e3, delay.getMax() / 1e3,
+            flow.jitters ? (double)flow.jitterNs / flow.jitters / 1e6 : 0.0);
+    }
+    fclose(file);
+}
+void FlowStats::print(std::ostream &os, const std::vector<std::string> &names)
+{
+    for(std::size_t i = 0; i < m_flows.size(); i++){
+        const Flow &flow = m_flows[i];
+        std::size_t vehicleId = i / FLOW_DIRECTIONS;
+        double span = (flow.lastRx - flow.firstRx).GetSeconds();
+
+        if(flow.txPackets == 0){
+            continue;
+        }
+        os << (vehicleId < names.size() ? names[vehicleId] : to_string(vehicleId)) << " " << flowDirectionNames[i % FLOW_DIRECTIONS]
+            << " TxBytes= " << flow.txBytes << ", RxBytes= " << flow.rxBytes
+            << ", throughput= " << (span > 0 ? flow.rxBytes * 8.0 / span / 1e6 : 0.0) << " Mbps"
+            << ", delay p50= " << flow.delayUs.getPercentile(50) / 1e3 << " ms, p99= " << flow.delayUs.getPercentile(99) / 1e3 << " ms"
+            << ", packet lost= " << flow.txPackets - std::min(flow.rxPackets, flow.txPackets) << endl;
+    }
+}
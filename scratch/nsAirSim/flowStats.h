@@ -0,0 +1,129 @@
+#ifndef INCLUDE_FLOWSTATS_H
+#define INCLUDE_FLOWSTATS_H
+
+// std includes
+#include <vector>
+#include <string>
+#include <memory>
+#include <cstdio>
+#include <unordered_map>
+// ns3 includes
+#include "ns3/core-module.h"
+#include "ns3/network-module.h"
+#include "ns3/internet-module.h"
+// custom includes
+#include "logHistogram.h"
+
+using namespace std;
+using namespace ns3;
+
+enum FlowDirection
+{
+    FLOW_UP = 0, // UAV -> GCS
+    FLOW_DOWN, // GCS -> UAV, TCP acks of the up direction included
+    FLOW_DIRECTIONS
+};
+// "up", "down", the direction column of the CSVs
+extern const char *flowDirectionNames[FLOW_DIRECTIONS];
+
+/*
+* Stamped on the IP payload when a watched node sends it. A byte tag like
+* FlowMonitor's, it survives GTP tunnelling and LTE/Wifi segmentation.
+*/
+class FlowStatsTag: public Tag
+{
+public:
+    FlowStatsTag();
+    FlowStatsTag(uint16_t vehicleId, uint8_t direction, int64_t txTimeNs);
+
+    /**
+    * Register this type.
+    * \return The TypeId.
+    */
+    static TypeId GetTypeId(void);
+    virtual TypeId GetInstanceTypeId(void) const;
+    virtual uint32_t GetSerializedSize(void) const;
+    virtual void Serialize(TagBuffer i) const;
+    virtual void Deserialize(TagBuffer i);
+    virtual void Print(std::ostream &os) const;
+
+    uint16_t GetVehicleId(void) const {return m_vehicleId;}
+    uint8_t GetDirection(void) const {return m_direction;}
+    int64_t GetTxTimeNs(void) const {return m_txTimeNs;}
+private:
+    uint16_t m_vehicleId;
+    uint8_t m_direction;
+    int64_t m_txTimeNs;
+};
+
+/*
+* IP level statistics of the traffic between every UAV and the GCS, one flow
+* per UAV and direction. Kept incrementally from the Ipv4L3Protocol traces
+* of the end nodes, delays go to fixed size histograms, so the memory is the
+* same after a minute or after hours, whatever the number of packets.
+*
+* sample() appends one row per flow active since the previous sample to a
+* CSV, writeSummary() one row per flow with the totals at the end. Packets
+* still in flight at the end are counted as lost.
+*/
+class FlowStats
+{
+public:
+    FlowStats(std::size_t numOfUav);
+    ~FlowStats();
+
+    void watchGcs(Ptr<Node> gcsNode, Ipv4Address gcsAddress);
+    void watchUav(uint16_t vehicleId, Ptr<Node> uavNode, Ipv4Address uavAddress);
+
+    // per-sample rows go to path, nothing is written without it
+    void openSamples(const std::string &path);
+    // close the interval since the previous sample, tick labels its rows
+    void sample(uint32_t tick);
+    void writeSummary(const std::string &path, const std::vector<std::string> &names);
+    // one line per flow with traffic
+    void print(std::ostream &os, const std::vector<std::string> &names);
+private:
+    struct Flow
+    {
+        // since the start
+        uint64_t txPackets = 0;
+        uint64_t rxPackets = 0;
+        uint64_t txBytes = 0;
+        uint64_t rxBytes = 0;
+        Time firstRx;
+        Time lastRx;
+        LogHistogram delayUs;
+        int64_t jitterNs = 0; // sum of |delay - delay of the previous packet|
+        uint64_t jitters = 0;
+        int64_t lastDelayNs = -1;
+        // since the previous sample
+        uint64_t txPacketsSample = 0;
+        uint64_t rxPacketsSample = 0;
+        uint64_t txBytesSample = 0;
+        uint64_t rxBytesSample = 0;
+        int64_t delayNsSample = 0;
+        int64_t delayMaxNsSample = 0;
+        int64_t jitterNsSample = 0;
+        uint64_t jittersSample = 0;
+    };
+    struct Watched
+    {
+        FlowStats *stats;
+        uint16_t vehicleId; // UAV nodes only
+    };
+
+    static void gcsSend(Watched *watched, const Ipv4Header &header, Ptr<const Packet> packet, uint32_t interface);
+    static void uavSend(Watched *watched, const Ipv4Header &header, Ptr<const Packet> packet, uint32_t interface);
+    static void localDeliver(Watched *watched, const Ipv4Header &header, Ptr<const Packet> packet, uint32_t interface);
+    void send(uint16_t vehicleId, FlowDirection direction, Ptr<const Packet> packet);
+    void connect(Ptr<Node> node, Watched *watched, bool gcs);
+
+    Ipv4Address m_gcsAddress;
+    std::unordered_map<Ipv4Address, uint16_t, Ipv4AddressHash> m_uavAddresses;
+    std::vector<Flow> m_flows; // vehicleId * FLOW_DIRECTIONS + direction
+    std::vector< std::unique_ptr<Watched> > m_watched; // trace callback contexts
+    FILE *m_samples = nullptr;
+    Time m_lastSample;
+};
+
+#endif
@@ -3,6 +3,7 @@
 #include <map>
 #include <string>
 #include <cstring>
+#include <algorithm>
 // ns3 includes
 #include "ns3/core-module.h"
 #include "ns3/network-module.h"
@@ -25,6 +26,7 @@ STRICT_MODE_ON
 // custom includes
 #include "gcsApp.h"
 #include "AirSimSync.h"
+#include "traceLog.h"
 
 using namespace std;
 using namespace ns3;
@@ -49,24 +51,40 @@ TypeId GcsApp::GetTypeId(void)
     return tid;
 }
 
-/* Init ns stuff, RPC client connection and zmq socket init, connect */
-void GcsApp::Setup (zmq::context_t &context, Ptr<Socket> socket, Address address, 
-    std::map<std::string, Ptr<ConstantPositionMobilityModel> > uavsMobility,
-    int zmqRecvPort, int zmqSendPort
+/* Init ns stuff, RPC client connection and attach to the zmq mux */
+void GcsApp::Setup (ZmqMux *mux, Ptr<Socket> socket, Address address, 
+    std::vector<std::string> uavsName, std::vector< Ptr<AirSimMobilityModel> > uavsMobility,
+    int rpcConcurrency, PayloadStore *payloadStore, SessionLog *sessionLog, MsgLatency *msgLatency
 )
 {
+    m_mux = mux;
+    m_payloadStore = payloadStore;
+    m_sessionLog = sessionLog;
+    m_msgLatency = msgLatency;
     m_socket = socket;
     m_address = address;
+    m_uavsName = uavsName;
     m_uavsMobility = uavsMobility;
+    m_uavPeers = std::vector<Peer*>(m_uavsName.size(), nullptr);
+    m_rxBytesFrom = std::vector<uint64_t>(m_uavsName.size(), 0);
+    m_nextOtherId = m_uavsName.size();
+    for(std::size_t i = 0; i < m_uavsName.size(); i++){
+        m_uavsId[m_uavsName[i]] = i;
+    }
 
-    m_zmqSocketSend = zmq::socket_t(context, ZMQ_PUSH);
-    m_zmqSocketSend.bind("tcp://*:" + to_string(zmqSendPort));
-    m_zmqSocketRecv = zmq::socket_t(context, ZMQ_REP);
-    m_zmqSocketRecv.connect("tcp://localhost:" + to_string(zmqRecvPort));
-
+    // no use to open more connections than vehicles
+    // 0 means poses are pushed by AirSim (usePoseStream) and RPC is not used at all
+    if(rpcConcurrency > 0){
+        rpcConcurrency = std::max(1, std::min(rpcConcurrency, (int)m_uavsName.size()));
+    }
+    for(int i = 0; i < rpcConcurrency; i++){
+        m_clients.push_back(std::unique_ptr<msr::airlib::MultirotorRpcLibClient>(new msr::airlib::MultirotorRpcLibClient()));
+    }
     try{
-        m_client.confirmConnection();
-        NS_LOG_INFO("GCS connected with AirSim");
+        for(auto &client:m_clients){
+            client->confirmConnection();
+        }
+        NS_LOG_INFO("GCS connected with AirSim using " << m_clients.size() << " RPC clients");
     }
     catch (rpc::rpc_error&  e) {
         std::string msg = e.get_error().as<std::string>();
@@ -74,6 +92,19 @@ void GcsApp::Setup (zmq::context_t &context, Ptr<Socket> socket, Address address
     }
 }
 
+void GcsApp::setUdp(uint32_t udpClasses, Address udpAddress, std::vector<InetSocketAddress> uavsUdpAddress, uint32_t udpMaxPayload)
+{
+    m_udpClasses = udpClasses;
+    m_udpAddress = udpAddress;
+    m_udpMaxPayload = udpMaxPayload;
+    m_uavsUdpAddress = uavsUdpAddress;
+    m_reassemblers = std::vector<MsgReassembler>(m_uavsUdpAddress.size());
+    m_udpVehicleIds.clear();
+    for(std::size_t i = 0; i < m_uavsUdpAddress.size(); i++){
+        m_udpVehicleIds[m_uavsUdpAddress[i].GetIpv4()] = i;
+    }
+}
+
 void GcsApp::StartApplication(void)
 {
     // init members
@@ -85,9 +116,6 @@ void GcsApp::StartApplication(void)
     // This call will disable any Send()
     // m_socket->ShutdownSend();
     
-    m_socket->SetRecvCallback(
-        MakeCallback(&GcsApp::recvCallback, this)
-    );
     m_socket->SetAcceptCallback(
         MakeNullCallback<bool, Ptr<Socket>, const Address &>(),
         MakeCallback(&GcsApp::acceptCallback, this)
@@ -97,6 +125,23 @@ void GcsApp::StartApplication(void)
         MakeCallback(&GcsApp::peerErrorCallback, this)
     );
 
+    if(m_udpClasses){
+        m_udpSocket = Socket::CreateSocket(GetNode(), UdpSocketFactory::GetTypeId());
+        if(m_udpSocket->Bind(m_udpAddress)){
+            NS_FATAL_ERROR("[GCS] failed to bind m_udpSocket");
+        }
+        m_udpSocket->SetRecvCallback(MakeCallback(&GcsApp::recvUdpCallback, this));
+        if(m_payloadStore){
+            PayloadStore *store = m_payloadStore;
+            for(auto &it:m_reassemblers){
+                it.setDropHandler([store](Ptr<Packet> fragment){store->release(fragment);});
+            }
+        }
+    }
+
+    if(m_clients.size() > 1){
+        m_rpcPool.reset(new WorkerPool(m_clients.size() - 1));
+    }
     mobilityUpdateDirect();
     m_running = true;
     NS_LOG_INFO("[GCS starts]");
@@ -104,6 +149,7 @@ void GcsApp::StartApplication(void)
 void GcsApp::StopApplication(void)
 {
     m_running = false;
+    m_rpcPool.reset();
     while(!m_events.empty()){
         EventId event = m_events.front();
         if(event.IsRunning()){
@@ -114,26 +160,28 @@ void GcsApp::StopApplication(void)
     if(m_socket){
         m_socket->Close();
     }
-    for(auto &it:m_connectedSockets){
-        it.second->Close();
+    for(auto &it:m_peers){
+        it->socket->Close();
+    }
+    if(m_udpSocket){
+        uint64_t dropped = 0;
+        for(auto &it:m_reassemblers){
+            dropped += it.getDropped();
+        }
+        m_udpSocket->Close();
+        NS_LOG_INFO("[GCS] gave up on " << dropped << " incomplete UDP messages");
     }
-
-    m_zmqSocketSend.close();
-    m_zmqSocketRecv.close();
 
     NS_LOG_INFO("[GCS] stopped");
 }
 
-/*<sim_time> <name> <payload> */
-void GcsApp::scheduleTx(void)
+void GcsApp::scheduleTx(Time step, std::size_t count)
 {
-    zmq::message_t message;
-    double now = Simulator::Now().GetSeconds();
-    zmq::recv_result_t res;
-    
-    zmq::message_t rep(4);
-
     if(!m_running){
+        // a counted tick must still be taken off the mux, or the next one would start early
+        if(count != MUX_DRAIN_ALL){
+            m_mux->drain([](const MsgHeader &hdr, zmq::message_t &message){return -1;}, count);
+        }
         return;
     }
 
@@ -141,92 +189,199 @@ void GcsApp::scheduleTx(void)
         m_events.pop();
     }
 
-    res = m_zmqSocketRecv.recv(message, zmq::recv_flags::dontwait);
-    while(res.has_value() && res.value() != -1){ // EAGAIN
-        std::size_t head;
-        std::string name;
-        const uint8_t *payload = NULL;
-        int repRes = -1;
-
-        head = message.to_string().find(' ');
-        name = message.to_string().substr(0, head);
-        payload = (const uint8_t*)message.data() + head + 1;
+    m_mux->drain([this, step](const MsgHeader &hdr, zmq::message_t &message){
+        return sendToUav(hdr.vehicleId, message, ZmqMux::sendDelay(hdr, step), hdr.msgClass);
+    }, count);
+}
+/* <payload> */
+int GcsApp::sendToUav(uint16_t vehicleId, zmq::message_t &message, Time delay, uint8_t msgClass)
+{
+    double now = Simulator::Now().GetSeconds();
+    int repRes = -1;
 
-        if(m_connectedSockets.find(name) != m_connectedSockets.end()){
-            Ptr<Packet> packet = Create<Packet>((const uint8_t*)payload, message.size()-(payload - (const uint8_t*)message.data()));
-            repRes = m_connectedSockets[name]->Send(packet);
+    // straight from AirSim, a bad id costs its message and nothing else
+    if(vehicleId >= m_uavPeers.size()){
+        NS_LOG_WARN("time: " << now << ", [GCS drop] a packet supposed to be sent to vehicle " << vehicleId);
+        return repRes;
+    }
+    // datagrams need no connection
+    Peer *peer = m_uavPeers[vehicleId];
+    if(!peer && !usesUdp(msgClass)){
+        NS_LOG_WARN("time: " << now << ", [GCS drop] " << m_uavsName[vehicleId] << " is not connected yet");
+        return repRes;
+    }
 
-            if(repRes < 0){
-                NS_LOG_WARN("time: " << now << ", [GCS send] to " << name << " " << packet->GetSize() << " bytes ERROR" << repRes);
-            }
-            else{
-                NS_LOG_INFO("time: " << now << ", [GCS send] to " << name << " " << packet->GetSize() << " bytes");
-            }
+    Ptr<Packet> packet;
+    if(m_payloadStore && message.size()){
+        packet = m_payloadStore->store(message);
+    }
+    else{
+        packet = Create<Packet>((const uint8_t*)message.data(), message.size());
+    }
+    if(delay.IsStrictlyPositive()){
+        m_events.push(Simulator::Schedule(delay, &GcsApp::sendPacket, this, vehicleId, packet, msgClass));
+        return 0;
+    }
+    return sendPacket(vehicleId, packet, msgClass);
+}
+int GcsApp::sendPacket(uint16_t vehicleId, Ptr<Packet> packet, uint8_t msgClass)
+{
+    double now = Simulator::Now().GetSeconds();
+    int repRes = -1;
+    // may have reconnected since the send was scheduled
+    Peer *peer = m_uavPeers[vehicleId];
+    bool udp = usesUdp(msgClass);
+    if(!peer && !udp){
+        NS_LOG_WARN("time: " << now << ", [GCS drop] " << m_uavsName[vehicleId] << " is not connected anymore");
+        if(m_payloadStore){
+            m_payloadStore->release(packet);
         }
-        else{
-            NS_FATAL_ERROR("[GCS drop] a packet supposed to be sent to " << name);
+        return repRes;
+    }
+    if(m_msgLatency){
+        m_msgLatency->stamp(packet);
+    }
+    uint32_t size = MsgFramer::messageSize(packet);
+    repRes = udp ? sendDatagrams(vehicleId, packet, msgClass) : peer->socket->Send(MsgFramer::frame(packet, FRAME_DATA, msgClass));
+    if(repRes > 0){
+        m_txBytes += repRes;
+        if(udp){
+            m_udpTxBytes += repRes;
         }
-        *(int*)rep.data() = repRes;
-        m_zmqSocketRecv.send(rep, zmq::send_flags::dontwait);
+    }
 
-        message.rebuild();
-        res = m_zmqSocketRecv.recv(message, zmq::recv_flags::dontwait);
+    TraceLog::trace(TRACE_GCS_SEND, GetNode()->GetId(), vehicleId, size, repRes);
+    if(repRes < 0){
+        NS_LOG_WARN("time: " << now << ", [GCS send] to " << m_uavsName[vehicleId] << " " << size << " bytes ERROR" << repRes);
+        if(m_payloadStore){
+            m_payloadStore->release(packet);
+        }
     }
+    return repRes;
 }
 
-/* <from-address> <payload> then forward to application code */
-void GcsApp::recvCallback(Ptr<Socket> socket)
+int GcsApp::sendDatagrams(uint16_t vehicleId, Ptr<Packet> body, uint8_t msgClass)
+{
+    int sent = 0;
+
+    if(vehicleId >= m_uavsUdpAddress.size()){
+        return -1;
+    }
+    for(auto &it:MsgReassembler::fragment(body, FRAME_DATA, msgClass, m_nextMsgId++, m_udpMaxPayload)){
+        int res = m_udpSocket->SendTo(it, 0, m_uavsUdpAddress[vehicleId]);
+        if(res < 0){
+            return res;
+        }
+        sent += res;
+    }
+    return sent;
+}
+
+/* <frames> then forward to application code */
+void GcsApp::recvCallback(Peer *peer, Ptr<Socket> socket)
+{
+    Ptr<Packet> packet;
+
+    while((packet = socket->Recv())){
+        if(peer->id < peer->app->m_uavsName.size()){
+            peer->app->m_rxBytes += packet->GetSize();
+            peer->app->m_rxBytesFrom[peer->id] += packet->GetSize();
+        }
+        peer->framer.feed(packet, [peer](uint8_t type, uint8_t msgClass, Ptr<Packet> body){
+            peer->app->recvFrame(*peer, type, msgClass, body);
+        });
+    }
+}
+/* <datagram>, the vehicle is known by the source address */
+void GcsApp::recvUdpCallback(Ptr<Socket> socket)
 {
     Ptr<Packet> packet;
     Address from;
-    std::size_t pos;
-    std::string s;
+
+    while((packet = socket->RecvFrom(from))){
+        auto it = m_udpVehicleIds.find(InetSocketAddress::ConvertFrom(from).GetIpv4());
+        if(it == m_udpVehicleIds.end()){
+            NS_LOG_WARN("time: " << Simulator::Now().GetSeconds() << ", [GCS recv] drop a datagram from unknown " << from);
+            continue;
+        }
+        uint16_t vehicleId = it->second;
+        m_rxBytes += packet->GetSize();
+        m_udpRxBytes += packet->GetSize();
+        m_rxBytesFrom[vehicleId] += packet->GetSize();
+        m_reassemblers[vehicleId].feed(packet, [this, vehicleId](uint8_t type, uint8_t msgClass, Ptr<Packet> body){
+            if(type == FRAME_DATA){
+                recvMessage(vehicleId, msgClass, body);
+            }
+        });
+    }
+}
+void GcsApp::recvFrame(Peer &peer, uint8_t type, uint8_t msgClass, Ptr<Packet> body)
+{
     float now = Simulator::Now().GetSeconds();
-    
-    packet = socket->RecvFrom(from);
-    zmq::message_t message(packet->GetSize());
-    packet->CopyData((uint8_t *)message.data(), packet->GetSize());
 
-    /* @@ We may leave the job to application */
-    pos = message.to_string().find("name");
-    if(pos != std::string::npos){
-        std::stringstream ss(message.to_string());
-        std::string name;
-        ss >> name;
-        ss >> name;
+    if(type == FRAME_HELLO){
+        authCallback(peer, body);
+        return;
+    }
+    if(type != FRAME_DATA){
+        NS_LOG_WARN("time: " << now << ", [GCS recv] unexpected frame type " << (int)type);
+        return;
+    }
+    recvMessage(peer.id, msgClass, body);
+}
+void GcsApp::recvMessage(uint16_t vehicleId, uint8_t msgClass, Ptr<Packet> body)
+{
+    // congestion peers are not stamped, and are past the UAVs anyway
+    if(m_msgLatency){
+        m_msgLatency->record(vehicleId, FLOW_UP, body);
+    }
 
-        m_connectedSockets[name] = socket;
-        m_uavsAddress2Name[from] = name;
-        if(m_socketSet.find(socket) == m_socketSet.end()){
-            NS_FATAL_ERROR("[GCS] Socket map not found Error");
-        }
-        else{
-            NS_LOG_INFO("Time:" << Simulator::Now().GetSeconds() << ", [GCS auth] from \"" << name << "\"");
+    if(m_payloadStore){
+        std::vector<zmq::message_t> done;
+        m_payloadStore->reassemble(body, done);
+        for(auto &it:done){
+            TraceLog::trace(TRACE_GCS_RECV, GetNode()->GetId(), vehicleId, it.size());
+            m_mux->send(vehicleId, it, msgClass);
         }
+        return;
     }
-    else{
-        // forward to application code
-        std::string name = m_uavsAddress2Name[from];
-        std::size_t sz = name.size() + 1 + packet->GetSize();
-        zmq::message_t message(sz);
-        uint8_t *p = (uint8_t*)message.data();
-        memcpy(p, name.c_str(), name.size());
-        p += name.size();
-        *p = ' ';
-        p++;
+    zmq::message_t message(body->GetSize());
+    body->CopyData((uint8_t *)message.data(), body->GetSize());
+    TraceLog::trace(TRACE_GCS_RECV, GetNode()->GetId(), vehicleId, body->GetSize());
+    m_mux->send(vehicleId, message, msgClass);
+}
+/* <name> */
+void GcsApp::authCallback(Peer &peer, Ptr<Packet> body)
+{
+    std::string name(body->GetSize(), '\0');
+    body->CopyData((uint8_t *)&name[0], name.size());
 
-        packet->CopyData(p, packet->GetSize());
-        m_zmqSocketSend.send(message, zmq::send_flags::dontwait);
-        NS_LOG_INFO("time: " << now << ", [GCS recv] from-" << m_uavsAddress2Name[from] << ", " << packet->GetSize() << " bytes");
+    auto it = m_uavsId.find(name);
+    if(it != m_uavsId.end()){
+        peer.id = it->second;
+        m_uavPeers[peer.id] = &peer;
     }
-
+    else{
+        // not a UAV (e.g. congestion nodes), gets an id past the UAVs
+        // once those run out they share MSG_NO_VEHICLE
+        if(m_nextOtherId == MSG_NO_VEHICLE){
+            NS_LOG_WARN("Time:" << Simulator::Now().GetSeconds() << ", [GCS auth] out of vehicle ids for \"" << name << "\"");
+        }
+        peer.id = m_nextOtherId;
+        if(m_nextOtherId < MSG_NO_VEHICLE){
+            m_nextOtherId++;
+        }
+    }
+    NS_LOG_INFO("Time:" << Simulator::Now().GetSeconds() << ", [GCS auth] from \"" << name << "\" as vehicle " << peer.id);
+    TraceLog::trace(TRACE_GCS_AUTH, GetNode()->GetId(), peer.id, body->GetSize());
 }
 void GcsApp::acceptCallback(Ptr<Socket> s, const Address& from)
 {
     // connected uavs must send their name first
-    s->SetRecvCallback (MakeCallback (&GcsApp::recvCallback, this));
-    m_socketSet.insert(s);
+    m_peers.emplace_back(new Peer{this, s, MsgFramer(), MSG_NO_VEHICLE});
+    s->SetRecvCallback (MakeBoundCallback (&GcsApp::recvCallback, m_peers.back().get()));
     NS_LOG_INFO("Time: " << Simulator::Now().GetSeconds() << " [GCS accept] from " << from);
+    TraceLog::trace(TRACE_GCS_ACCEPT, GetNode()->GetId(), MSG_NO_VEHICLE, 0);
 }
 void GcsApp::peerCloseCallback(Ptr<Socket> socket)
 {
@@ -237,14 +392,74 @@ void GcsApp::peerErrorCallback(Ptr<Socket> socket)
     ;
 }
 
+void GcsApp::fetchKinematics(std::size_t first, std::size_t stride, std::vector<msr::airlib::Kinematics::State> &states)
+{
+    msr::airlib::MultirotorRpcLibClient &client = *m_clients[first];
+    for(std::size_t i = first; i < m_uavsName.size(); i += stride){
+        states[i] = client.simGetGroundTruthKinematics(m_uavsName[i]);
+    }
+}
 void GcsApp::mobilityUpdateDirect()
 {
-    for(auto it:m_uavsMobility){
-        msr::airlib::Kinematics::State state = m_client.simGetGroundTruthKinematics(it.first);
-        float x, y, z;
-        x = state.pose.position.x();
-        y = state.pose.position.y();
-        y = state.pose.position.z();
-        ns3::Simulator::ScheduleNow(&ConstantPositionMobilityModel::SetPosition, it.second, Vector(x, y, z));
+    std::size_t stride = m_clients.size();
+    std::vector<msr::airlib::Kinematics::State> states(m_uavsName.size());
+
+    if(m_sessionLog && m_sessionLog->isReplay()){
+        replayPoses();
+        return;
+    }
+    if(m_uavsName.empty() || m_clients.empty()){
+        return;
+    }
+    // issue all stripes together, the simulator thread takes stripe 0 itself
+    // and rpc errors are rethrown in it
+    if(m_rpcPool){
+        m_rpcPool->run([this, stride, &states](std::size_t c){
+            fetchKinematics(c, stride, states);
+        });
+    }
+    else{
+        for(std::size_t c = 0; c < stride; c++){
+            fetchKinematics(c, stride, states);
+        }
     }
-}
\ No newline at end of file
+
+    std::vector<LogPose> poses(states.size());
+    for(std::size_t i = 0; i < states.size(); i++){
+        const msr::airlib::Kinematics::State &state = states[i];
+        LogPose &pose = poses[i];
+        for(int k = 0; k < 3; k++){
+            pose.pos[k] = state.pose.position[k];
+            pose.vel[k] = state.twist.linear[k];
+            pose.acc[k] = state.accelerations.linear[k];
+        }
+        Vector pos(pose.pos[0], pose.pos[1], pose.pos[2]);
+        Vector vel(pose.vel[0], pose.vel[1], pose.vel[2]);
+        Vector acc(pose.acc[0], pose.acc[1], pose.acc[2]);
+        ns3::Simulator::ScheduleNow(&AirSimMobilityModel::SetKinematics, m_uavsMobility[i], pos, vel, acc);
+    }
+    if(m_sessionLog){
+        m_sessionLog->write(LOG_POSES, 0, poses.data(), poses.size() * sizeof(LogPose));
+    }
+}
+void GcsApp::replayPoses()
+{
+    const uint8_t *data;
+    std::size_t size;
+
+    // nothing was fetched at this tick when AirSim pushed a pose frame instead
+    if(!m_sessionLog->read(LOG_POSES, 0, data, size)){
+        return;
+    }
+    if(size != m_uavsMobility.size() * sizeof(LogPose)){
+        NS_LOG_WARN("[GCS] recorded poses of " << size / sizeof(LogPose) << " UAVs, " << m_uavsMobility.size() << " expected");
+    }
+    for(std::size_t i = 0; i < m_uavsMobility.size() && (i + 1) * sizeof(LogPose) <= size; i++){
+        LogPose pose;
+        memcpy(&pose, data + i * sizeof(LogPose), sizeof(pose));
+        Vector pos(pose.pos[0], pose.pos[1], pose.pos[2]);
+        Vector vel(pose.vel[0], pose.vel[1], pose.vel[2]);
+        Vector acc(pose.acc[0], pose.acc[1], pose.acc[2]);
+        ns3::Simulator::ScheduleNow(&AirSimMobilityModel::SetKinematics, m_uavsMobility[i], pos, vel, acc);
+    }
+}
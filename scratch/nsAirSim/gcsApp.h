@@ -5,8 +5,10 @@
 // std includes
 #include <vector>
 #include <map>
+#include <unordered_map>
 #include <string>
 #include <queue>
+#include <memory>
 // ns3 includes
 #include "ns3/core-module.h"
 #include "ns3/network-module.h"
@@ -27,6 +29,14 @@ STRICT_MODE_ON
 #include "common/common_utils/FileSystem.hpp"
 // zmq includes
 #include <zmq.hpp>
+// custom includes
+#include "airSimMobilityModel.h"
+#include "zmqMux.h"
+#include "virtualPayload.h"
+#include "msgFramer.h"
+#include "msgLatency.h"
+#include "sessionLog.h"
+#include "workerPool.h"
 
 using namespace std;
 using namespace ns3;
@@ -42,22 +52,63 @@ public:
     * \return The TypeId.
     */
     static TypeId GetTypeId (void);
-    void Setup (zmq::context_t &context, Ptr<Socket> socket, Address address, 
-        std::map<std::string, Ptr<ConstantPositionMobilityModel> > uavsMobility,
-        int zmqRecvPort, int zmqSendPort
+    // uavsName and uavsMobility are indexed by vehicle id
+    void Setup (ZmqMux *mux, Ptr<Socket> socket, Address address, 
+        std::vector<std::string> uavsName, std::vector< Ptr<AirSimMobilityModel> > uavsMobility,
+        int rpcConcurrency = 1, PayloadStore *payloadStore = nullptr, SessionLog *sessionLog = nullptr,
+        MsgLatency *msgLatency = nullptr
     );
-    void scheduleTx(void);
+    // messages of the classes set in udpClasses go as datagrams from udpAddress,
+    // uavsUdpAddress is indexed by vehicle id, datagrams are told apart by their source address
+    void setUdp(uint32_t udpClasses, Address udpAddress, std::vector<InetSocketAddress> uavsUdpAddress, uint32_t udpMaxPayload);
+    // drain the GCS mux into a tick of length step, see ZmqMux::drain for count
+    void scheduleTx(Time step, std::size_t count = MUX_DRAIN_ALL);
+    // send one message of msgClass from AirSim delay from now
+    // returns the Send() result, or 0 once a delayed send is scheduled
+    int sendToUav(uint16_t vehicleId, zmq::message_t &message, Time delay = Seconds(0), uint8_t msgClass = 0);
     void mobilityUpdateDirect(); // direct message from AirSim not UAVs
+    // bytes accepted by Send() and received from UAVs, framing included
+    uint64_t getTxBytes(void) const {return m_txBytes;}
+    uint64_t getRxBytes(void) const {return m_rxBytes;}
+    uint64_t getRxBytes(uint16_t vehicleId) const {return m_rxBytesFrom[vehicleId];}
+    // the UDP class share of those, datagrams may never arrive
+    uint64_t getUdpTxBytes(void) const {return m_udpTxBytes;}
+    uint64_t getUdpRxBytes(void) const {return m_udpRxBytes;}
 
 private:
+    // one accepted connection
+    struct Peer
+    {
+        GcsApp *app;
+        Ptr<Socket> socket;
+        MsgFramer framer;
+        uint16_t id; // vehicle id once the handshake is done
+    };
+
     virtual void StartApplication (void);
     virtual void StopApplication (void);
 
     void Tx(Ptr<Socket> socket, Ptr<Packet> packet) {socket->Send(packet);}
+    int sendPacket(uint16_t vehicleId, Ptr<Packet> packet, uint8_t msgClass);
+    // bytes sent, or the first failed Send() result
+    int sendDatagrams(uint16_t vehicleId, Ptr<Packet> body, uint8_t msgClass);
+    bool usesUdp(uint8_t msgClass) const {return m_udpSocket && msgClassUsesUdp(m_udpClasses, msgClass);}
+    // fetch every stride-th vehicle starting at first with m_clients[first]
+    void fetchKinematics(std::size_t first, std::size_t stride, std::vector<msr::airlib::Kinematics::State> &states);
+    // apply the poses recorded for this tick instead of fetching them
+    void replayPoses(void);
 
     // socket callbacks
     void acceptCallback(Ptr<Socket> s, const Address& from);
-    void recvCallback(Ptr<Socket> socket);
+    // bound to the peer of each accepted socket, no lookup per receive
+    static void recvCallback(Peer *peer, Ptr<Socket> socket);
+    void recvFrame(Peer &peer, uint8_t type, uint8_t msgClass, Ptr<Packet> body);
+    // one datagram socket for every UAV
+    void recvUdpCallback(Ptr<Socket> socket);
+    // a complete FRAME_DATA message from either transport
+    void recvMessage(uint16_t vehicleId, uint8_t msgClass, Ptr<Packet> body);
+    // body of a FRAME_HELLO is the UAV's name
+    void authCallback(Peer &peer, Ptr<Packet> body);
     void peerCloseCallback(Ptr<Socket> socket);
     void peerErrorCallback(Ptr<Socket> socket);
 
@@ -67,17 +118,38 @@ private:
     Address m_address;
     std::queue<EventId> m_events;
     
-    std::set< Ptr<Socket> > m_socketSet; // update on accept()
-    std::map<Address, std::string> m_uavsAddress2Name;
-    std::map< std::string, Ptr<Socket> > m_connectedSockets;
-    
+    std::vector< std::unique_ptr<Peer> > m_peers; // update on accept()
+    std::vector<Peer*> m_uavPeers; // indexed by vehicle id, update on handshake
+    std::unordered_map<std::string, uint16_t> m_uavsId; // only used on handshake
+    uint16_t m_nextOtherId; // next id given to a peer that is not a UAV
+
+    // UDP classes, the socket is only created when some are set
+    uint32_t m_udpClasses = 0;
+    Ptr<Socket> m_udpSocket;
+    Address m_udpAddress;
+    uint32_t m_udpMaxPayload = 0;
+    uint32_t m_nextMsgId = 0;
+    std::vector<InetSocketAddress> m_uavsUdpAddress; // indexed by vehicle id
+    std::unordered_map<Ipv4Address, uint16_t, Ipv4AddressHash> m_udpVehicleIds; // source address to vehicle id
+    std::vector<MsgReassembler> m_reassemblers; // indexed by vehicle id
+
     // use their names to refer to AirSim vehicle key and update mobility directly
-    std::map< std::string, Ptr<ConstantPositionMobilityModel> > m_uavsMobility;
+    std::vector<std::string> m_uavsName;
+    std::vector< Ptr<AirSimMobilityModel> > m_uavsMobility;
 
     // custom application member
-    zmq::socket_t m_zmqSocketSend;
-    zmq::socket_t m_zmqSocketRecv;
-    msr::airlib::MultirotorRpcLibClient m_client;
+    ZmqMux *m_mux; // owned by main
+    PayloadStore *m_payloadStore; // size-only packets if set, owned by main
+    uint64_t m_txBytes = 0;
+    uint64_t m_rxBytes = 0;
+    uint64_t m_udpTxBytes = 0;
+    uint64_t m_udpRxBytes = 0;
+    std::vector<uint64_t> m_rxBytesFrom; // indexed by vehicle id
+    SessionLog *m_sessionLog; // fetched poses are recorded or replayed if set, owned by main
+    MsgLatency *m_msgLatency; // messages are stamped and timed if set, owned by main
+    // pool of RPC connections, at most one in-flight call per client
+    std::vector< std::unique_ptr<msr::airlib::MultirotorRpcLibClient> > m_clients;
+    std::unique_ptr<WorkerPool> m_rpcPool; // one worker per client but the first, from StartApplication on
 };
 
 #endif
\ No newline at end of file
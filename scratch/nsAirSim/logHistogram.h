@@ -0,0 +1,99 @@
+#ifndef INCLUDE_LOGHISTOGRAM_H
+#define INCLUDE_LOGHISTOGRAM_H
+
+// std includes
+#include <array>
+#include <cstdint>
+#include <algorithm>
+
+using namespace std;
+
+#define LOG_HISTOGRAM_SUB_BITS (4) // 16 linear buckets per power of two, within 1/16 of the value
+#define LOG_HISTOGRAM_BITS (32) // values up to 2^32 - 1, larger ones land in the last bucket
+#define LOG_HISTOGRAM_SUB (1 << LOG_HISTOGRAM_SUB_BITS)
+#define LOG_HISTOGRAM_BUCKETS ((LOG_HISTOGRAM_BITS - LOG_HISTOGRAM_SUB_BITS + 1) * LOG_HISTOGRAM_SUB)
+
+/*
+* Fixed size log-linear histogram of unsigned values, HDR histogram style.
+* Values below LOG_HISTOGRAM_SUB get a bucket each, every power of two above
+* is split into LOG_HISTOGRAM_SUB buckets. Adding is a couple of shifts, the
+* memory never grows however long the run, and percentiles are off by at most
+* one bucket width.
+*/
+class LogHistogram
+{
+public:
+    LogHistogram() {m_counts.fill(0);}
+
+    void reset(void)
+    {
+        if(m_count){
+            *this = LogHistogram();
+        }
+    }
+
+    void add(uint64_t value)
+    {
+        m_counts[index(value)]++;
+        m_count++;
+        m_sum += value;
+        m_min = std::min(m_min, value);
+        m_max = std::max(m_max, value);
+    }
+    void merge(const LogHistogram &other)
+    {
+        for(std::size_t i = 0; i < m_counts.size(); i++){
+            m_counts[i] += other.m_counts[i];
+        }
+        m_count += other.m_count;
+        m_sum += other.m_sum;
+        m_min = std::min(m_min, other.m_min);
+        m_max = std::max(m_max, other.m_max);
+    }
+
+    uint64_t getCount(void) const {return m_count;}
+    uint64_t getMin(void) const {return m_count ? m_min : 0;}
+    uint64_t getMax(void) const {return m_max;}
+    double getMean(void) const {return m_count ? (double)m_sum / m_count : 0.0;}
+    // highest value of the bucket holding the p-th percentile, p in [0, 100]
+    uint64_t getPercentile(double p) const
+    {
+        uint64_t rank = (uint64_t)(p / 100.0 * m_count + 0.5);
+        uint64_t seen = 0;
+
+        if(m_count == 0){
+            return 0;
+        }
+        rank = std::max<uint64_t>(1, std::min(rank, m_count));
+        for(std::size_t i = 0; i < m_counts.size(); i++){
+            seen += m_counts[i];
+            if(seen >= rank){
+                return std::min(upper(i), m_max);
+            }
+        }
+        return m_max;
+    }
+private:
+    static std::size_t index(uint64_t value)
+    {
+        if(value < 2 * LOG_HISTOGRAM_SUB){
+            return value;
+        }
+        unsigned shift = 63 - __builtin_clzll(value) - LOG_HISTOGRAM_SUB_BITS;
+        return std::min<std::size_t>(shift * LOG_HISTOGRAM_SUB + (value >> shift), LOG_HISTOGRAM_BUCKETS - 1);
+    }
+    static uint64_t upper(std::size_t i)
+    {
+        unsigned shift = (i < 2 * LOG_HISTOGRAM_SUB) ? 0 : i / LOG_HISTOGRAM_SUB - 1;
+        uint64_t base = i - shift * LOG_HISTOGRAM_SUB;
+        return ((base + 1) << shift) - 1;
+    }
+
+    std::array<uint64_t, LOG_HISTOGRAM_BUCKETS> m_counts;
+    uint64_t m_count = 0;
+    uint64_t m_sum = 0;
+    uint64_t m_min = UINT64_MAX;
+    uint64_t m_max = 0;
+};
+
+#endif
@@ -1,6 +1,12 @@
 // std includes
 #include <vector>
-#include <ctime>
+#include <cmath>
+#include <string>
+#include <memory>
+#include <chrono>
+#include <fstream>
+#include <algorithm>
+#include <sys/resource.h>
 // ns3 includes
 #include "ns3/core-module.h"
 #include "ns3/network-module.h"
@@ -14,8 +20,6 @@
 #include "ns3/lte-helper.h"
 #include "ns3/epc-helper.h"
 #include "ns3/lte-module.h"
-#include "ns3/flow-monitor-helper.h"
-#include "ns3/ipv4-flow-probe.h"
 // zmq includes
 #include <zmq.hpp>
 // custom includes
@@ -23,6 +27,16 @@
 #include "uavApp.h"
 #include "congApp.h"
 #include "AirSimSync.h"
+#include "airSimMobilityModel.h"
+#include "zmqMux.h"
+#include "zmqIoThread.h"
+#include "netStateMonitor.h"
+#include "flowStats.h"
+#include "msgLatency.h"
+#include "virtualPayload.h"
+#include "sessionLog.h"
+#include "tickProfiler.h"
+#include "traceLog.h"
 
 // LTE topology (useWifi=0)
 // 
@@ -52,17 +66,109 @@ NS_LOG_COMPONENT_DEFINE ("NS_AIRSIM");
 
 NetConfig config;
 
+// machine readable summary of one run, see airSimStandIn/benchScaling.py
+static void writeBenchOutput(const std::string &path, const AirSimSync &sync, const ZmqMux &gcsMux, const ZmqMux &uavMux,
+  double simSeconds, double wallSeconds)
+{
+  const LogHistogram &turns = sync.getTurnWallTimes();
+  std::ofstream os(path);
+  struct rusage usage;
+
+  if(!os){
+    NS_LOG_WARN("cannot write bench output to " << path);
+    return;
+  }
+  getrusage(RUSAGE_SELF, &usage);
+
+  os << "{" << endl;
+  os << "  \"numOfUav\": " << config.uavsName.size() << "," << endl;
+  os << "  \"numOfCong\": " << config.numOfCong << "," << endl;
+  os << "  \"updateGranularity\": " << config.updateGranularity << "," << endl;
+  os << "  \"useWifi\": " << config.useWifi << "," << endl;
+  // seconds, percentiles within a bucket of the histogram
+  os << "  \"turns\": " << turns.getCount() << "," << endl;
+  os << "  \"turnWallMean\": " << turns.getMean() / 1e6 << "," << endl;
+  os << "  \"turnWallP50\": " << turns.getPercentile(50) / 1e6 << "," << endl;
+  os << "  \"turnWallP99\": " << turns.getPercentile(99) / 1e6 << "," << endl;
+  os << "  \"turnWallMax\": " << turns.getMax() / 1e6 << "," << endl;
+  os << "  \"gcsMsgs\": " << gcsMux.getDrained() << "," << endl;
+  os << "  \"uavMsgs\": " << uavMux.getDrained() << "," << endl;
+  os << "  \"gcsMsgsPerSec\": " << gcsMux.getDrained() / wallSeconds << "," << endl;
+  os << "  \"uavMsgsPerSec\": " << uavMux.getDrained() / wallSeconds << "," << endl;
+  os << "  \"simSeconds\": " << simSeconds << "," << endl;
+  os << "  \"wallSeconds\": " << wallSeconds << "," << endl;
+  os << "  \"simToWallRatio\": " << simSeconds / wallSeconds << "," << endl;
+  os << "  \"peakRssKb\": " << usage.ru_maxrss << endl;
+  os << "}" << endl;
+}
+
 int main(int argc, char *argv[])
 {
   // local vars
   zmq::context_t context(1);
-  srand (static_cast <unsigned> (time(0)));
+  int rpcConcurrency = 8;
+  bool virtualPayload = false;
+  std::string recordPath;
+  std::string replayPath;
+  std::unique_ptr<SessionLog> sessionLog;
+  std::string benchOutput;
+  int profilePort = 0;
+  std::string profileRing;
+  uint32_t profileRingSlots = 65536;
+  double tickBudget = 0.0;
+  std::unique_ptr<TickProfiler> profiler;
+  std::string tracePath;
+  bool packetPrinting = false;
+  std::unique_ptr<TraceLog> traceLog;
+  bool realtime = false;
+  double lagInterval = 1.0;
+  bool ioThread = false;
+  uint32_t ioQueueCapacity = IO_QUEUE_CAPACITY;
+  std::string netConfigPath;
+  double congUdpShare = 0.0;
+  std::string flowStatsPrefix;
+  std::string msgLatencyPrefix;
 
   CommandLine cmd (__FILE__);
+  cmd.AddValue ("rpcConcurrency", "Max number of concurrent RPC connections used to fetch UAV kinematics", rpcConcurrency);
+  cmd.AddValue ("virtualPayload", "Simulate packets by size only, payloads wait out of band until delivered", virtualPayload);
+  cmd.AddValue ("record", "Record everything received from AirSim to this file", recordPath);
+  cmd.AddValue ("replay", "Replay a recorded session instead of connecting to AirSim", replayPath);
+  cmd.AddValue ("benchOutput", "Write turn timings, message rates and peak RSS as JSON to this file", benchOutput);
+  cmd.AddValue ("profilePort", "Publish per-tick phase timings on a PUB socket bound to this port, 0 disables", profilePort);
+  cmd.AddValue ("profileRing", "Write per-tick phase timings to this memory mapped ring file", profileRing);
+  cmd.AddValue ("profileRingSlots", "Number of ticks kept in the ring file", profileRingSlots);
+  cmd.AddValue ("tickBudget", "Warn when a tick takes longer than this many wall seconds, 0 disables", tickBudget);
+  cmd.AddValue ("trace", "Write a binary per-packet trace to this file, see decodeTrace.py", tracePath);
+  cmd.AddValue ("packetPrinting", "Enable ns-3 packet metadata printing, slow", packetPrinting);
+  cmd.AddValue ("realtime", "Run against the wall clock, AirSim never waits on ns and messages are not acknowledged", realtime);
+  cmd.AddValue ("lagInterval", "Seconds between reports of how far the simulation lags the wall clock in realtime mode, 0 disables", lagInterval);
+  cmd.AddValue ("netConfig", "Read NetConfig from this file, msgpack or text, instead of waiting for AirSim to send it", netConfigPath);
+  cmd.AddValue ("congUdpShare", "Share of the congestion nodes sending UDP, the others use CongApp::Protocol", congUdpShare);
+  cmd.AddValue ("flowStats", "Write per-tick UAV flow samples to <prefix>.ticks.csv and per-flow totals to <prefix>.flows.csv", flowStatsPrefix);
+  cmd.AddValue ("msgLatency", "Write per-tick message latency to <prefix>.ticks.csv and per-UAV totals to <prefix>.vehicles.csv", msgLatencyPrefix);
+  cmd.AddValue ("ioThread", "Move the AirSim sockets to a background I/O thread feeding lock-free queues", ioThread);
+  cmd.AddValue ("ioQueueCapacity", "Messages each I/O thread queue holds, about the messages of one tick", ioQueueCapacity);
   cmd.Parse (argc, argv);
 
-  AirSimSync sync(context);
-  sync.readNetConfigFromAirSim(config);
+  if(realtime){
+    if(!recordPath.empty() || !replayPath.empty()){
+      NS_FATAL_ERROR("realtime cannot be combined with record or replay, the arrival times depend on the wall clock");
+    }
+    // best effort: fall behind rather than abort when the network model is too slow
+    GlobalValue::Bind ("SimulatorImplementationType", StringValue ("ns3::RealtimeSimulatorImpl"));
+    Config::SetDefault ("ns3::RealtimeSimulatorImpl::SynchronizationMode", StringValue ("BestEffort"));
+  }
+
+  if(!replayPath.empty()){
+    sessionLog.reset(new SessionLog(replayPath, SessionLog::REPLAY));
+  }
+  else if(!recordPath.empty()){
+    sessionLog.reset(new SessionLog(recordPath, SessionLog::RECORD));
+  }
+
+  AirSimSync sync(context, sessionLog.get());
+  sync.readNetConfig(config, netConfigPath);
 
   if(config.isMainLogEnabled) {LogComponentEnable("NS_AIRSIM", LOG_LEVEL_INFO);}
   if(config.isGcsLogEnabled) {LogComponentEnable("GcsApp", LOG_LEVEL_INFO);}
@@ -96,7 +202,12 @@ int main(int argc, char *argv[])
   Config::SetDefault("ns3::TcpSocket::RcvBufSize", UintegerValue(config.TcpRcvBufSize));
 
   // Packet level settings
-  ns3::Packet::EnablePrinting();
+  if(packetPrinting){
+    ns3::Packet::EnablePrinting();
+  }
+  if(!tracePath.empty()){
+    traceLog.reset(new TraceLog(tracePath));
+  }
 
   // ==========================================================================
   // Node containers
@@ -131,7 +242,7 @@ int main(int argc, char *argv[])
   for(uint32_t i = 0; i < uavNodes.GetN(); i++){
     initPosUavAlloc->Add(Vector(0, 0, 0));
   }
-  mobilityUav.SetMobilityModel("ns3::ConstantPositionMobilityModel");
+  mobilityUav.SetMobilityModel("AirSimMobilityModel"); // extrapolates between updates
   mobilityUav.SetPositionAllocator(initPosUavAlloc);
   mobilityUav.Install(uavNodes); // allocate corresponding indexed initial position
 
@@ -298,14 +409,40 @@ int main(int argc, char *argv[])
 
   // ==========================================================================
   // UAV
-  std::map<std::string, Ptr<ConstantPositionMobilityModel> > uavsMobility;
+  std::vector< Ptr<AirSimMobilityModel> > uavsMobility; // indexed by vehicle id
   std::vector< Ptr<UavApp> > uavsApp;
   // GCS
   Address gcsSinkAddress(InetSocketAddress (gcsIpfaces.GetAddress(0), GCS_PORT_START)); // get the 0th address anyway. GCS + PGW (LTE) | GCS (Wifi)
   Ptr<Socket> gcsTcpSocket = Socket::CreateSocket(gcsNode, TcpSocketFactory::GetTypeId());
+  ZmqMux uavMux(context, AIRSIM2NS_UAV_PORT, NS2AIRSIM_UAV_PORT, config.asyncAck); // all UAVs share one endpoint pair
+  ZmqMux gcsMux(context, AIRSIM2NS_GCS_PORT, NS2AIRSIM_GCS_PORT, config.asyncAck);
+  PayloadStore payloadStore;
+  // messages are only stamped when their latency is asked for
+  std::unique_ptr<MsgLatency> msgLatency;
+  if(!msgLatencyPrefix.empty()){
+    msgLatency.reset(new MsgLatency(config.uavsName.size()));
+  }
+  if(sessionLog){
+    uavMux.setSessionLog(sessionLog.get(), LOG_CHANNEL_UAV);
+    gcsMux.setSessionLog(sessionLog.get(), LOG_CHANNEL_GCS);
+  }
+  // realtime polls the sockets on its own thread, replay has none
+  std::unique_ptr<ZmqIoThread> zmqIo;
+  if(ioThread && !realtime && replayPath.empty()){
+    zmqIo.reset(new ZmqIoThread(context, std::max<uint32_t>(ioQueueCapacity, 1)));
+    zmqIo->add(&uavMux);
+    zmqIo->add(&gcsMux);
+  }
   Ptr<GcsApp> gcsApp = CreateObject<GcsApp>();
+  std::unique_ptr<NetStateMonitor> netStateMonitor;
+  if(config.netState){
+    netStateMonitor.reset(new NetStateMonitor(config.uavsName.size(), config.useWifi));
+  }
   // Cong
   std::vector< Ptr<CongApp> > congsApp;
+  // UDP classes, a datagram must fit the link MTU with its headers
+  uint32_t udpMaxPayload = config.p2pMtu - UDP_IP_OVERHEAD - DatagramHeader().GetSerializedSize();
+  std::vector<InetSocketAddress> uavsUdpAddress;
 
   // Add application to uavNodes
   NS_LOG_INFO("Add UAV app");
@@ -319,81 +456,146 @@ int main(int argc, char *argv[])
     Ptr<UavApp> app = CreateObject<UavApp>();
     
     uavNodes.Get(i)->AddApplication(app);
-    app->Setup(context, uavTcpSocket, uavMyAddress, gcsSinkAddress,
-      AIRSIM2NS_PORT_START + i, NS2AIRSIM_PORT_START + i, config.uavsName[i]
+    app->Setup(&uavMux, i, uavTcpSocket, uavMyAddress, gcsSinkAddress,
+      config.uavsName[i], virtualPayload ? &payloadStore : nullptr, msgLatency.get()
     );
+    if(config.udpClasses){
+      app->setUdp(config.udpClasses, InetSocketAddress(uavAddress, UAV_UDP_PORT),
+        InetSocketAddress(gcsIpfaces.GetAddress(0), GCS_UDP_PORT), udpMaxPayload
+      );
+    }
+    uavsUdpAddress.push_back(InetSocketAddress(uavAddress, UAV_UDP_PORT));
     app->SetStartTime(Seconds(UAV_APP_START_TIME));
     app->SetStopTime(Simulator::GetMaximumSimulationTime());
+    if(netStateMonitor){
+      netStateMonitor->watchTcp(i, uavTcpSocket, config.TcpSndBufSize);
+      if(config.useWifi){
+        netStateMonitor->watchWifi(i, uavDevices.Get(i), enbApDevices);
+      }
+      else{
+        netStateMonitor->watchLte(i, uavDevices.Get(i));
+      }
+    }
 
-    uavsMobility[config.uavsName[i]] = uavNodes.Get(i)->GetObject<ConstantPositionMobilityModel>();    
+    uavsMobility.push_back(uavNodes.Get(i)->GetObject<AirSimMobilityModel>());
     uavsApp.push_back(app);
   }
 
   // Add application to gcsNode
   NS_LOG_INFO("Add GCS app");
   gcsNode->AddApplication(gcsApp);
-  gcsApp->Setup(context, gcsTcpSocket, InetSocketAddress(Ipv4Address::GetAny(), GCS_PORT_START), 
-    uavsMobility,
-    AIRSIM2NS_GCS_PORT , NS2AIRSIM_GCS_PORT
+  gcsApp->Setup(&gcsMux, gcsTcpSocket, InetSocketAddress(Ipv4Address::GetAny(), GCS_PORT_START), 
+    config.uavsName, uavsMobility,
+    (config.usePoseStream || !replayPath.empty()) ? 0 : rpcConcurrency, virtualPayload ? &payloadStore : nullptr,
+    sessionLog.get(), msgLatency.get()
   );
+  if(config.udpClasses){
+    gcsApp->setUdp(config.udpClasses, InetSocketAddress(Ipv4Address::GetAny(), GCS_UDP_PORT), uavsUdpAddress, udpMaxPayload);
+  }
   gcsApp->SetStartTime(Seconds(GCS_APP_START_TIME));
   gcsApp->SetStopTime(Simulator::GetMaximumSimulationTime());
   
   // Add application to cong node
   NS_LOG_INFO("Add Cong app");
+  // streams are fixed per node, --RngRun picks another repeatable draw
+  int64_t congStream = 0;
+  uint32_t congUdpNodes = std::round(std::min(std::max(congUdpShare, 0.0), 1.0) * congNodes.GetN());
+  Address congUdpSinkAddress(InetSocketAddress (gcsIpfaces.GetAddress(0), CONG_UDP_PORT));
   for(int i = 0; i < congNodes.GetN(); i++){  
-    uint16_t congPort = CONG_PORT_START; // use the same port as uav does
-    Ptr<Node> cong = congNodes.Get(i);
-    Ipv4Address congAddress = congIpfaces.GetAddress(i);
-    Ptr<Socket> congTcpSocket = Socket::CreateSocket(congNodes.Get(i), TcpSocketFactory::GetTypeId());
-    Address congMyAddress(InetSocketAddress(Ipv4Address::GetAny(), congPort));
     Ptr<CongApp> app = CreateObject<CongApp>();
     std::string name("anoy");
 
     name += to_string(i);    
     congNodes.Get(i)->AddApplication(app);
-    app->Setup(congTcpSocket, congMyAddress, gcsSinkAddress,
-      config.congRate, name
-    );
+    if(i < congUdpNodes){
+      app->SetAttribute("Protocol", EnumValue(CONG_PROTOCOL_UDP));
+    }
+    app->Setup(gcsSinkAddress, congUdpSinkAddress, config.congRate, name);
+    congStream += app->AssignStreams(congStream);
     app->SetStartTime(Seconds(CONG_APP_START_TIME));
     app->SetStopTime(Simulator::GetMaximumSimulationTime());
 
     congsApp.push_back(app);
   }
+  if(congNodes.GetN() > 0){
+    // UDP congestion ends here, TCP congestion connects to the GCS app like a UAV
+    PacketSinkHelper congUdpSink("ns3::UdpSocketFactory", InetSocketAddress(Ipv4Address::GetAny(), CONG_UDP_PORT));
+    ApplicationContainer sinkApps = congUdpSink.Install(gcsNode);
+    sinkApps.Start(Seconds(GCS_APP_START_TIME));
+  }
 
   // ==========================================================================
   // Monitor
-  FlowMonitorHelper flowmon;
-  Ptr<FlowMonitor> uavMonitor = flowmon.Install(uavNodes.Get(0));
-  Ptr<FlowMonitor> gcsMonitor = flowmon.Install(gcsNode);
+  FlowStats flowStats(config.uavsName.size());
+  flowStats.watchGcs(gcsNode, gcsIpfaces.GetAddress(0));
+  for(uint32_t i = 0; i < uavNodes.GetN(); i++){
+    flowStats.watchUav(i, uavNodes.Get(i), uavIpfaces.GetAddress(i));
+  }
+  if(!flowStatsPrefix.empty()){
+    flowStats.openSamples(flowStatsPrefix + ".ticks.csv");
+    sync.setFlowStats(&flowStats);
+  }
+  if(msgLatency){
+    msgLatency->openSamples(msgLatencyPrefix + ".ticks.csv");
+    sync.setMsgLatency(msgLatency.get());
+  }
 
   // ==========================================================================
   // Run
+  sync.setUavsMobility(uavsMobility);
+  sync.setUavMux(&uavMux);
+  sync.setGcsMux(&gcsMux);
+  if(profilePort > 0 || !profileRing.empty() || tickBudget > 0){
+    profiler.reset(new TickProfiler(context, profilePort, profileRing, profileRingSlots, tickBudget));
+    profiler->setMuxes(&gcsMux, &uavMux);
+    sync.setProfiler(profiler.get());
+  }
+  sync.setNetStateMonitor(netStateMonitor.get());
   sync.startAirSim();
-  Simulator::ScheduleNow(&AirSimSync::takeTurn, &sync, gcsApp, uavsApp);
+  if(zmqIo){
+    zmqIo->start();
+  }
+  if(realtime){
+    sync.startRealtime(gcsApp, uavsApp, Seconds(lagInterval));
+  }
+  else{
+    Simulator::ScheduleNow(&AirSimSync::takeTurn, &sync, gcsApp, uavsApp);
+  }
   // Simulator::Stop(Seconds(1.99));
+  auto wallStart = std::chrono::steady_clock::now();
   Simulator::Run();
+  if(realtime){
+    sync.stopRealtime();
+  }
+  if(zmqIo){
+    zmqIo->stop();
+  }
+  double wallSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - wallStart).count();
+
+  if(!benchOutput.empty()){
+    writeBenchOutput(benchOutput, sync, gcsMux, uavMux, Simulator::Now().GetSeconds(), wallSeconds);
+  }
   
   // ==========================================================================
   // Report
-  NS_LOG_INFO("UAV monitor:");
-  uavMonitor->CheckForLostPackets ();
-  Ptr<Ipv4FlowClassifier> uavClassifier = DynamicCast<Ipv4FlowClassifier> (flowmon.GetClassifier ());
-  FlowMonitor::FlowStatsContainer uavStats = uavMonitor->GetFlowStats ();
-  for (std::map<FlowId, FlowMonitor::FlowStats>::const_iterator i = uavStats.begin (); i != uavStats.end (); ++i){
-    Ipv4FlowClassifier::FiveTuple t = uavClassifier->FindFlow (i->first);
-    std::cout << "source=" << t.sourceAddress << ", dest=" << t.destinationAddress << " TxBytes= " << i->second.txBytes << ", throughput= "<< i->second.txBytes * 8.0 / (i->second.timeLastTxPacket.GetSeconds() - i->second.timeFirstTxPacket.GetSeconds()+0.001) / 1000 / 1000  << " Mbps"  << endl;
-    std::cout << "packet lost=" << i->second.lostPackets << endl;
-  }
-
-  NS_LOG_INFO("GCS monitor:");
-  gcsMonitor->CheckForLostPackets ();
-  Ptr<Ipv4FlowClassifier> gcsClassifier = DynamicCast<Ipv4FlowClassifier> (flowmon.GetClassifier ());
-  FlowMonitor::FlowStatsContainer gcsStats = gcsMonitor->GetFlowStats ();
-  for (std::map<FlowId, FlowMonitor::FlowStats>::const_iterator i = gcsStats.begin (); i != gcsStats.end (); ++i){
-    Ipv4FlowClassifier::FiveTuple t = gcsClassifier->FindFlow (i->first);
-    std::cout << "source=" << t.sourceAddress << ", dest=" << t.destinationAddress << " TxBytes= " << i->second.txBytes << ", throughput= "<< i->second.txBytes * 8.0 / (i->second.timeLastTxPacket.GetSeconds() - i->second.timeFirstTxPacket.GetSeconds()+0.001) / 1000 / 1000  << " Mbps"  << endl;
-    std::cout << "packet lost=" << i->second.lostPackets << endl;
+  NS_LOG_INFO("UAV flows:");
+  flowStats.print(std::cout, config.uavsName);
+  if(!flowStatsPrefix.empty()){
+    flowStats.writeSummary(flowStatsPrefix + ".flows.csv", config.uavsName);
+  }
+  if(msgLatency){
+    NS_LOG_INFO("UAV message latency:");
+    msgLatency->print(std::cout, config.uavsName);
+    msgLatency->writeSummary(msgLatencyPrefix + ".vehicles.csv", config.uavsName);
+  }
+
+  if(virtualPayload){
+    std::cout << "virtual payloads pending= " << payloadStore.size() << ", dropped= " << payloadStore.getDropped() << endl;
+  }
+
+  NS_LOG_INFO("UAV mobility:");
+  for(int i = 0; i < uavsMobility.size(); i++){
+    std::cout << config.uavsName[i] << " extrapolation error mean= " << uavsMobility[i]->GetMeanError() << " m, max= " << uavsMobility[i]->GetMaxError() << " m" << endl;
   }
 
   // ==========================================================================
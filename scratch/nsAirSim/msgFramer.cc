@@ -0,0 +1,234 @@
+// std includes
+#include <algorithm>
+// ns3 includes
+#include "ns3/core-module.h"
+#include "ns3/network-module.h"
+// custom includes
+#include "msgFramer.h"
+
+using namespace std;
+using namespace ns3;
+
+NS_LOG_COMPONENT_DEFINE ("MsgFramer");
+NS_OBJECT_ENSURE_REGISTERED (FrameHeader);
+NS_OBJECT_ENSURE_REGISTERED (DatagramHeader);
+
+FrameHeader::FrameHeader(): m_type(0), m_length(0), m_msgClass(0)
+{
+}
+FrameHeader::FrameHeader(uint8_t type, uint32_t length, uint8_t msgClass): m_type(type), m_length(length), m_msgClass(msgClass)
+{
+}
+TypeId FrameHeader::GetTypeId(void)
+{
+    static TypeId tid = TypeId("FrameHeader")
+        .SetParent<Header>()
+        .SetGroupName("ns3_AirSim")
+        .AddConstructor<FrameHeader>()
+    ;
+    return tid;
+}
+TypeId FrameHeader::GetInstanceTypeId(void) const
+{
+    return GetTypeId();
+}
+uint32_t FrameHeader::GetSerializedSize(void) const
+{
+    return sizeof(m_length) + sizeof(m_type) + sizeof(m_msgClass);
+}
+void FrameHeader::Serialize(Buffer::Iterator start) const
+{
+    start.WriteHtonU32(m_length);
+    start.WriteU8(m_type);
+    start.WriteU8(m_msgClass);
+}
+uint32_t FrameHeader::Deserialize(Buffer::Iterator start)
+{
+    m_length = start.ReadNtohU32();
+    m_type = start.ReadU8();
+    m_msgClass = start.ReadU8();
+    return GetSerializedSize();
+}
+void FrameHeader::Print(std::ostream &os) const
+{
+    os << "type=" << (int)m_type << " length=" << m_length << " class=" << (int)m_msgClass;
+}
+
+DatagramHeader::DatagramHeader(): m_type(0), m_msgClass(0), m_msgId(0), m_index(0), m_count(0)
+{
+}
+DatagramHeader::DatagramHeader(uint8_t type, uint8_t msgClass, uint32_t msgId, uint16_t index, uint16_t count):
+    m_type(type), m_msgClass(msgClass), m_msgId(msgId), m_index(index), m_count(count)
+{
+}
+TypeId DatagramHeader::GetTypeId(void)
+{
+    static TypeId tid = TypeId("DatagramHeader")
+        .SetParent<Header>()
+        .SetGroupName("ns3_AirSim")
+        .AddConstructor<DatagramHeader>()
+    ;
+    return tid;
+}
+TypeId DatagramHeader::GetInstanceTypeId(void) const
+{
+    return GetTypeId();
+}
+uint32_t DatagramHeader::GetSerializedSize(void) const
+{
+    return sizeof(m_type) + sizeof(m_msgClass) + sizeof(m_msgId) + sizeof(m_index) + sizeof(m_count);
+}
+void DatagramHeader::Serialize(Buffer::Iterator start) const
+{
+    start.WriteU8(m_type);
+    start.WriteU8(m_msgClass);
+    start.WriteHtonU32(m_msgId);
+    start.WriteHtonU16(m_index);
+    start.WriteHtonU16(m_count);
+}
+uint32_t DatagramHeader::Deserialize(Buffer::Iterator start)
+{
+    m_type = start.ReadU8();
+    m_msgClass = start.ReadU8();
+    m_msgId = start.ReadNtohU32();
+    m_index = start.ReadNtohU16();
+    m_count = start.ReadNtohU16();
+    return GetSerializedSize();
+}
+void DatagramHeader::Print(std::ostream &os) const
+{
+    os << "type=" << (int)m_type << " class=" << (int)m_msgClass << " id=" << m_msgId << " fragment=" << m_index << "/" << m_count;
+}
+
+MsgFramer::MsgFramer(): m_buffer(Create<Packet>()), m_need(FrameHeader().GetSerializedSize())
+{
+}
+Ptr<Packet> MsgFramer::frame(Ptr<Packet> body, uint8_t type, uint8_t msgClass)
+{
+    body->AddHeader(FrameHeader(type, body->GetSize(), msgClass));
+    return body;
+}
+void MsgFramer::feed(Ptr<Packet> chunk, const Handler &handler)
+{
+    m_buffer->AddAtEnd(chunk);
+    while(m_buffer->GetSize() >= m_need){
+        if(!m_hasHeader){
+            m_buffer->RemoveHeader(m_header);
+            m_hasHeader = true;
+            m_need = m_header.GetLength();
+            continue;
+        }
+        Ptr<Packet> body = m_buffer->CreateFragment(0, m_header.GetLength());
+        m_buffer->RemoveAtStart(m_header.GetLength());
+        m_hasHeader = false;
+        m_need = m_header.GetSerializedSize();
+        handler(m_header.GetType(), m_header.GetMsgClass(), body);
+    }
+}
+
+std::vector< Ptr<Packet> > MsgReassembler::fragment(Ptr<Packet> body, uint8_t type, uint8_t msgClass, uint32_t msgId, uint32_t maxPayload)
+{
+    uint32_t size = body->GetSize();
+    uint32_t count = std::max<uint32_t>(1, (size + maxPayload - 1) / maxPayload);
+    std::vector< Ptr<Packet> > datagrams;
+
+    if(count > UINT16_MAX){
+        NS_FATAL_ERROR("[MsgReassembler] a message of " << size << " bytes does not fit " << UINT16_MAX << " datagrams");
+    }
+    // byte tags of body follow their bytes into the fragments
+    for(uint32_t i = 0; i < count; i++){
+        uint32_t offset = i * maxPayload;
+        Ptr<Packet> datagram = body->CreateFragment(offset, std::min(maxPayload, size - offset));
+        datagram->AddHeader(DatagramHeader(type, msgClass, msgId, i, count));
+        datagrams.push_back(datagram);
+    }
+    return datagrams;
+}
+void MsgReassembler::feed(Ptr<Packet> datagram, const MsgFramer::Handler &handler)
+{
+    DatagramHeader header;
+
+    if(datagram->GetSize() < header.GetSerializedSize()){
+        NS_LOG_WARN("[MsgReassembler] drop a runt datagram of " << datagram->GetSize() << " bytes");
+        return;
+    }
+    datagram->RemoveHeader(header);
+    if(header.GetCount() == 0 || header.GetIndex() >= header.GetCount()){
+        NS_LOG_WARN("[MsgReassembler] drop a datagram with fragment " << header.GetIndex() << "/" << header.GetCount());
+        return;
+    }
+    uint32_t msgId = header.GetMsgId();
+    if(isFinished(msgId)){
+        // late or duplicate
+        return;
+    }
+    if(header.GetCount() == 1){
+        finish(msgId);
+        evict();
+        handler(header.GetType(), header.GetMsgClass(), datagram);
+        return;
+    }
+
+    auto it = m_partial.find(msgId);
+    if(it == m_partial.end()){
+        it = m_partial.emplace(msgId, Partial{header.GetType(), header.GetMsgClass(), 0, {}}).first;
+        it->second.fragments.resize(header.GetCount());
+    }
+    Partial &partial = it->second;
+    if(header.GetCount() != partial.fragments.size() || partial.fragments[header.GetIndex()]){
+        // duplicate, or a stale id reused
+        return;
+    }
+    partial.fragments[header.GetIndex()] = datagram;
+    partial.received++;
+
+    if(partial.received == partial.fragments.size()){
+        Ptr<Packet> body = Create<Packet>();
+        for(auto &fragment:partial.fragments){
+            body->AddAtEnd(fragment);
+        }
+        uint8_t type = partial.type;
+        uint8_t msgClass = partial.msgClass;
+        m_partial.erase(it);
+        finish(msgId);
+        evict();
+        handler(type, msgClass, body);
+        return;
+    }
+    evict();
+}
+bool MsgReassembler::isFinished(uint32_t msgId) const
+{
+    return (m_hasLow && MsgIdLess()(msgId, m_low)) || m_finished.count(msgId);
+}
+/* the oldest remembered ids fold into the low-water mark */
+void MsgReassembler::finish(uint32_t msgId)
+{
+    if(isFinished(msgId)){
+        return;
+    }
+    m_finished.insert(msgId);
+    while(m_finished.size() > UDP_REASSEMBLY_HISTORY){
+        m_low = *m_finished.begin() + 1;
+        m_hasLow = true;
+        m_finished.erase(m_finished.begin());
+    }
+}
+void MsgReassembler::evict(void)
+{
+    while(!m_partial.empty() && (m_partial.size() > UDP_REASSEMBLY_WINDOW || isFinished(m_partial.begin()->first))){
+        auto oldest = m_partial.begin();
+        uint32_t msgId = oldest->first;
+        if(m_dropHandler){
+            for(auto &it:oldest->second.fragments){
+                if(it){
+                    m_dropHandler(it);
+                    break;
+                }
+            }
+        }
+        m_partial.erase(oldest);
+        m_dropped++;
+        finish(msgId);
+    }
+}
@@ -0,0 +1,164 @@
+#ifndef INCLUDE_MSGFRAMER_H
+#define INCLUDE_MSGFRAMER_H
+
+// std includes
+#include <functional>
+#include <vector>
+#include <map>
+#include <set>
+// ns3 includes
+#include "ns3/core-module.h"
+#include "ns3/network-module.h"
+
+using namespace std;
+using namespace ns3;
+
+// frame types on the simulated sockets
+#define FRAME_HELLO (1) // body is the sender's name, first frame on a connection
+#define FRAME_DATA (2) // body is one application message
+
+#define UDP_REASSEMBLY_WINDOW (16) // incomplete messages kept per sender before the oldest is dropped
+#define UDP_REASSEMBLY_HISTORY (256) // ids of finished messages remembered per sender to drop late duplicates
+
+// message id order that survives the 32 bit wrap, serial number arithmetic as in RFC 1982
+struct MsgIdLess
+{
+    bool operator()(uint32_t a, uint32_t b) const {return (int32_t)(a - b) < 0;}
+};
+
+/*
+* | length | type | class | prepended to every application message sent over
+* the simulated TCP sockets, so that messages survive segmentation and coalescing
+*/
+class FrameHeader: public Header
+{
+public:
+    FrameHeader();
+    FrameHeader(uint8_t type, uint32_t length, uint8_t msgClass = 0);
+
+    /**
+    * Register this type.
+    * \return The TypeId.
+    */
+    static TypeId GetTypeId(void);
+    virtual TypeId GetInstanceTypeId(void) const;
+    virtual uint32_t GetSerializedSize(void) const;
+    virtual void Serialize(Buffer::Iterator start) const;
+    virtual uint32_t Deserialize(Buffer::Iterator start);
+    virtual void Print(std::ostream &os) const;
+
+    uint8_t GetType(void) const {return m_type;}
+    uint32_t GetLength(void) const {return m_length;}
+    uint8_t GetMsgClass(void) const {return m_msgClass;}
+private:
+    uint8_t m_type;
+    uint32_t m_length;
+    uint8_t m_msgClass;
+};
+
+/*
+* | type | class | message id | fragment index | fragment count | prepended to
+* every datagram of a message sent over the simulated UDP sockets
+*/
+class DatagramHeader: public Header
+{
+public:
+    DatagramHeader();
+    DatagramHeader(uint8_t type, uint8_t msgClass, uint32_t msgId, uint16_t index, uint16_t count);
+
+    /**
+    * Register this type.
+    * \return The TypeId.
+    */
+    static TypeId GetTypeId(void);
+    virtual TypeId GetInstanceTypeId(void) const;
+    virtual uint32_t GetSerializedSize(void) const;
+    virtual void Serialize(Buffer::Iterator start) const;
+    virtual uint32_t Deserialize(Buffer::Iterator start);
+    virtual void Print(std::ostream &os) const;
+
+    uint8_t GetType(void) const {return m_type;}
+    uint8_t GetMsgClass(void) const {return m_msgClass;}
+    uint32_t GetMsgId(void) const {return m_msgId;}
+    uint16_t GetIndex(void) const {return m_index;}
+    uint16_t GetCount(void) const {return m_count;}
+private:
+    uint8_t m_type;
+    uint8_t m_msgClass;
+    uint32_t m_msgId;
+    uint16_t m_index;
+    uint16_t m_count;
+};
+
+/*
+* Per-socket reassembly of framed messages. Chunks are appended as they come
+* and a frame is only looked at again once enough bytes for it are buffered.
+*/
+class MsgFramer
+{
+public:
+    typedef std::function<void(uint8_t type, uint8_t msgClass, Ptr<Packet> body)> Handler;
+
+    MsgFramer();
+    // prepend the frame header to body, returns body
+    static Ptr<Packet> frame(Ptr<Packet> body, uint8_t type, uint8_t msgClass = 0);
+    // size of a message as the receiving handler gets it. frame() grows body
+    // in place and fragment() adds a header per datagram, so senders take
+    // this before either one to trace and log the same size the receiver
+    // does, over TCP or UDP alike
+    static uint32_t messageSize(Ptr<const Packet> body) {return body->GetSize();}
+    // append a received chunk, every completed frame goes to handler once, in order
+    void feed(Ptr<Packet> chunk, const Handler &handler);
+private:
+    Ptr<Packet> m_buffer;
+    FrameHeader m_header;
+    bool m_hasHeader = false;
+    uint32_t m_need; // bytes m_buffer must hold before it is worth parsing
+};
+
+/*
+* Per-sender reassembly of messages sent as datagrams. Datagrams may be lost,
+* duplicated or reordered: a message goes to the handler once all of its
+* fragments are in, in whatever order messages complete. At most
+* UDP_REASSEMBLY_WINDOW incomplete messages are kept, the oldest is given up
+* first, so a lost fragment costs its message and nothing else.
+* Ids of messages delivered or given up on are remembered, the last
+* UDP_REASSEMBLY_HISTORY of them and a low-water mark below, so a late or
+* duplicate fragment is dropped instead of starting the message over.
+*/
+class MsgReassembler
+{
+public:
+    // gets a received fragment of every message given up on
+    typedef std::function<void(Ptr<Packet> fragment)> DropHandler;
+
+    // body cut into datagrams of at most maxPayload body bytes, each with a DatagramHeader
+    static std::vector< Ptr<Packet> > fragment(Ptr<Packet> body, uint8_t type, uint8_t msgClass, uint32_t msgId, uint32_t maxPayload);
+    void feed(Ptr<Packet> datagram, const MsgFramer::Handler &handler);
+    void setDropHandler(const DropHandler &dropHandler) {m_dropHandler = dropHandler;}
+
+    // messages given up on so far
+    uint64_t getDropped(void) const {return m_dropped;}
+private:
+    // true if msgId was delivered or given up on
+    bool isFinished(uint32_t msgId) const;
+    void finish(uint32_t msgId);
+    // give up on the oldest partials past the window or below the low-water mark
+    void evict(void);
+
+    struct Partial
+    {
+        uint8_t type;
+        uint8_t msgClass;
+        uint16_t received;
+        std::vector< Ptr<Packet> > fragments; // by index, null until received
+    };
+    std::map<uint32_t, Partial, MsgIdLess> m_partial; // by message id, oldest first
+    std::set<uint32_t, MsgIdLess> m_finished; // finished ids at or above m_low
+    uint32_t m_low = 0; // every id below is finished
+    bool m_hasLow = false;
+    uint64_t m_dropped = 0;
+    DropHandler m_dropHandler;
+};
+
+#endif
@@ -0,0 +1,142 @@
+// std includes
+#include <algorithm>
+// ns3 includes
+#include "ns3/core-module.h"
+#include "ns3/network-module.h"
+// custom includes
+#include "msgLatency.h"
+
+using namespace std;
+using namespace ns3;
+
+NS_LOG_COMPONENT_DEFINE ("MsgLatency");
+NS_OBJECT_ENSURE_REGISTERED (MsgLatencyTag);
+
+#define MSG_LATENCY_BUFFER (1 << 20) // bytes of sample rows buffered before a write
+
+MsgLatencyTag::MsgLatencyTag(): m_id(0), m_originNs(0)
+{
+}
+MsgLatencyTag::MsgLatencyTag(uint64_t id, int64_t originNs): m_id(id), m_originNs(originNs)
+{
+}
+TypeId MsgLatencyTag::GetTypeId(void)
+{
+    static TypeId tid = TypeId("MsgLatencyTag")
+        .SetParent<Tag>()
+        .SetGroupName("ns3_AirSim")
+        .AddConstructor<MsgLatencyTag>()
+    ;
+    return tid;
+}
+TypeId MsgLatencyTag::GetInstanceTypeId(void) const
+{
+    return GetTypeId();
+}
+uint32_t MsgLatencyTag::GetSerializedSize(void) const
+{
+    return sizeof(m_id) + sizeof(m_originNs);
+}
+void MsgLatencyTag::Serialize(TagBuffer i) const
+{
+    i.WriteU64(m_id);
+    i.WriteU64(m_originNs);
+}
+void MsgLatencyTag::Deserialize(TagBuffer i)
+{
+    m_id = i.ReadU64();
+    m_originNs = i.ReadU64();
+}
+void MsgLatencyTag::Print(std::ostream &os) const
+{
+    os << "id=" << m_id << " originNs=" << m_originNs;
+}
+
+MsgLatency::MsgLatency(std::size_t numOfUav)
+{
+    m_latency = std::vector<Latency>(numOfUav * FLOW_DIRECTIONS);
+}
+MsgLatency::~MsgLatency()
+{
+    if(m_samples){
+        fclose(m_samples);
+    }
+}
+
+void MsgLatency::stamp(Ptr<Packet> body)
+{
+    body->AddByteTag(MsgLatencyTag(m_nextId++, Simulator::Now().GetNanoSeconds()));
+}
+bool MsgLatency::record(uint16_t vehicleId, FlowDirection direction, Ptr<const Packet> body)
+{
+    MsgLatencyTag tag;
+
+    if(vehicleId * FLOW_DIRECTIONS >= m_latency.size() || !body->FindFirstMatchingByteTag(tag)){
+        return false;
+    }
+    Latency &latency = m_latency[vehicleId * FLOW_DIRECTIONS + direction];
+    uint64_t us = std::max<int64_t>(0, Simulator::Now().GetNanoSeconds() - tag.GetOriginNs()) / 1000;
+    latency.total.add(us);
+    latency.tick.add(us);
+    return true;
+}
+
+void MsgLatency::openSamples(const std::string &path)
+{
+    m_samples = fopen(path.c_str(), "w");
+    if(!m_samples){
+        NS_FATAL_ERROR("[MsgLatency] cannot create " << path);
+    }
+    setvbuf(m_samples, nullptr, _IOFBF, MSG_LATENCY_BUFFER);
+    fprintf(m_samples, "tick,simTime,vehicleId,direction,messages,latencyMeanMs,latencyP50Ms,latencyP99Ms,latencyMaxMs\n");
+}
+/* only UAVs that received something during the tick get a row */
+void MsgLatency::sample(uint32_t tick)
+{
+    double now = Simulator::Now().GetSeconds();
+
+    for(std::size_t i = 0; i < m_latency.size(); i++){
+        LogHistogram &h = m_latency[i].tick;
+        if(h.getCount() == 0){
+            continue;
+        }
+        if(m_samples){
+            fprintf(m_samples, "%u,%.6f,%zu,%s,%llu,%.3f,%.3f,%.3f,%.3f\n",
+                tick, now, i / FLOW_DIRECTIONS, flowDirectionNames[i % FLOW_DIRECTIONS], (unsigned long long)h.getCount(),
+                h.getMean() / 1e3, h.getPercentile(50) / 1e3, h.getPercentile(99) / 1e3, h.getMax() / 1e3);
+        }
+        h.reset();
+    }
+}
+void MsgLatency::writeSummary(const std::string &path, const std::vector<std::string> &names)
+{
+    FILE *file = fopen(path.c_str(), "w");
+    if(!file){
+        NS_FATAL_ERROR("[MsgLatency] cannot create " << path);
+    }
+    fprintf(file, "vehicleId,name,direction,messages,latencyMinMs,latencyMeanMs,latencyP50Ms,latencyP90Ms,latencyP99Ms,latencyP999Ms,latencyMaxMs\n");
+    for(std::size_t i = 0; i < m_latency.size(); i++){
+        const LogHistogram &h = m_latency[i].total;
+        std::size_t vehicleId = i / FLOW_DIRECTIONS;
+
+        fprintf(file, "%zu,%s,%s,%llu,%.3f,%.3f,%.3f,%.3f,%.3f,%.3f,%.3f\n",
+            vehicleId, vehicleId < names.size() ? names[vehicleId].c_str() : "", flowDirectionNames[i % FLOW_DIRECTIONS],
+            (unsigned long long)h.getCount(), h.getMin() / 1e3, h.getMean() / 1e3, h.getPercentile(50) / 1e3,
+            h.getPercentile(90) / 1e3, h.getPercentile(99) / 1e3, h.getPercentile(99.9) / 1e3, h.getMax() / 1e3);
+    }
+    fclose(file);
+}
+void MsgLatency::print(std::ostream &os, const std::vector<std::string> &names)
+{
+    for(std::size_t i = 0; i < m_latency.size(); i++){
+        const LogHistogram &h = m_latency[i].total;
+        std::size_t vehicleId = i / FLOW_DIRECTIONS;
+
+        if(h.getCount() == 0){
+            continue;
+        }
+        os << (vehicleId < names.size() ? names[vehicleId] : to_string(vehicleId)) << " " << flowDirectionNames[i % FLOW_DIRECTIONS]
+            << " messages= " << h.getCount() << ", latency mean= " << h.getMean() / 1e3 << " ms, p50= " << h.getPercentile(50) / 1e3
+            << " ms, p99= " << h.getPercentile(99) / 1e3 << " ms, max= " << h.getMax() / 1e3 << " ms" << endl;
+    }
+}
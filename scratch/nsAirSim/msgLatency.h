@@ -0,0 +1,84 @@
+#ifndef INCLUDE_MSGLATENCY_H
+#define INCLUDE_MSGLATENCY_H
+
+// std includes
+#include <vector>
+#include <string>
+#include <cstdio>
+// ns3 includes
+#include "ns3/core-module.h"
+#include "ns3/network-module.h"
+// custom includes
+#include "logHistogram.h"
+#include "flowStats.h"
+
+using namespace std;
+using namespace ns3;
+
+/*
+* Spans the body of one application message from the moment the app hands it
+* to its socket. A byte tag, so it stays on the message bytes however TCP
+* splits and coalesces them.
+*/
+class MsgLatencyTag: public Tag
+{
+public:
+    MsgLatencyTag();
+    MsgLatencyTag(uint64_t id, int64_t originNs);
+
+    /**
+    * Register this type.
+    * \return The TypeId.
+    */
+    static TypeId GetTypeId(void);
+    virtual TypeId GetInstanceTypeId(void) const;
+    virtual uint32_t GetSerializedSize(void) const;
+    virtual void Serialize(TagBuffer i) const;
+    virtual void Deserialize(TagBuffer i);
+    virtual void Print(std::ostream &os) const;
+
+    uint64_t GetId(void) const {return m_id;}
+    int64_t GetOriginNs(void) const {return m_originNs;}
+private:
+    uint64_t m_id;
+    int64_t m_originNs;
+};
+
+/*
+* One-way latency of application messages, from the sending app's Send() to
+* the receiving app holding the whole message, so TCP buffering, head of line
+* blocking and retransmissions are all in. One fixed size histogram per UAV
+* and direction for the whole run and one for the current tick. Shared by
+* the UAV and GCS apps, owned by main.
+*/
+class MsgLatency
+{
+public:
+    MsgLatency(std::size_t numOfUav);
+    ~MsgLatency();
+
+    // tag body with the next message id and the current time
+    void stamp(Ptr<Packet> body);
+    // account a complete message body, false if it was not stamped
+    bool record(uint16_t vehicleId, FlowDirection direction, Ptr<const Packet> body);
+
+    // per-sample rows go to path, nothing is written without it
+    void openSamples(const std::string &path);
+    // close the tick, its rows are labelled with tick
+    void sample(uint32_t tick);
+    void writeSummary(const std::string &path, const std::vector<std::string> &names);
+    // one line per UAV and direction with messages
+    void print(std::ostream &os, const std::vector<std::string> &names);
+private:
+    struct Latency
+    {
+        LogHistogram total; // us
+        LogHistogram tick; // us, since the previous sample
+    };
+
+    uint64_t m_nextId = 0;
+    std::vector<Latency> m_latency; // vehicleId * FLOW_DIRECTIONS + direction
+    FILE *m_samples = nullptr;
+};
+
+#endif
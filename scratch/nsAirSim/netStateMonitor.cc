@@ -0,0 +1,155 @@
+// std includes
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+// ns3 includes
+#include "ns3/core-module.h"
+#include "ns3/network-module.h"
+#include "ns3/internet-module.h"
+#include "ns3/lte-module.h"
+#include "ns3/wifi-module.h"
+// custom includes
+#include "netStateMonitor.h"
+
+using namespace std;
+using namespace ns3;
+
+NS_LOG_COMPONENT_DEFINE ("NetStateMonitor");
+
+#define NET_STATE_NO_MCS (0xFF)
+#define AMC_BER (0.00005) // target BER LteAmc assumes for its CQI mapping
+
+// non-HT OFDM rates in Mbps, their index stands in for an MCS
+static const double ofdmRates[] = {6, 9, 12, 18, 24, 36, 48, 54};
+
+NetStateMonitor::NetStateMonitor(std::size_t numOfUav, bool useWifi): m_useWifi(useWifi)
+{
+    NetStateEntry entry;
+    memset(&entry, 0, sizeof(entry));
+    entry.cell = NET_STATE_NO_CELL;
+    entry.mcs = NET_STATE_NO_MCS;
+
+    m_entries = std::vector<NetStateEntry>(numOfUav, entry);
+    for(std::size_t i = 0; i < numOfUav; i++){
+        m_entries[i].vehicleId = i;
+    }
+    m_sockets = std::vector<Ptr<Socket>>(numOfUav);
+    m_sndBufSizes = std::vector<uint32_t>(numOfUav, 0);
+    m_amc = CreateObject<LteAmc>();
+}
+
+void NetStateMonitor::watchLte(uint16_t vehicleId, Ptr<NetDevice> ueDevice)
+{
+    Ptr<LteUeNetDevice> ue = DynamicCast<LteUeNetDevice>(ueDevice);
+    if(!ue){
+        NS_FATAL_ERROR("[NetStateMonitor] vehicle " << vehicleId << " has no LTE UE device");
+    }
+    m_watched.emplace_back(new Watched{this, vehicleId, nullptr});
+    ue->GetPhy()->TraceConnectWithoutContext("ReportCurrentCellRsrpSinr",
+        MakeBoundCallback(&NetStateMonitor::rsrpSinr, m_watched.back().get()));
+}
+void NetStateMonitor::watchWifi(uint16_t vehicleId, Ptr<NetDevice> staDevice, const NetDeviceContainer &apDevices)
+{
+    Ptr<WifiNetDevice> sta = DynamicCast<WifiNetDevice>(staDevice);
+    if(!sta){
+        NS_FATAL_ERROR("[NetStateMonitor] vehicle " << vehicleId << " has no Wifi device");
+    }
+    if(m_aps.empty()){
+        for(uint32_t i = 0; i < apDevices.GetN(); i++){
+            m_aps.push_back(Mac48Address::ConvertFrom(apDevices.Get(i)->GetAddress()));
+        }
+    }
+    m_watched.emplace_back(new Watched{this, vehicleId, sta});
+    sta->GetPhy()->TraceConnectWithoutContext("MonitorSnifferRx",
+        MakeBoundCallback(&NetStateMonitor::snifferRx, m_watched.back().get()));
+}
+void NetStateMonitor::watchTcp(uint16_t vehicleId, Ptr<Socket> socket, uint32_t sndBufSize)
+{
+    m_sockets[vehicleId] = socket;
+    m_sndBufSizes[vehicleId] = sndBufSize;
+    m_watched.emplace_back(new Watched{this, vehicleId, nullptr});
+    socket->TraceConnectWithoutContext("CongestionWindow", MakeBoundCallback(&NetStateMonitor::cwnd, m_watched.back().get()));
+    socket->TraceConnectWithoutContext("RTT", MakeBoundCallback(&NetStateMonitor::rtt, m_watched.back().get()));
+}
+
+/* rsrp and sinr are linear, W and ratio */
+void NetStateMonitor::rsrpSinr(Watched *watched, uint16_t cellId, uint16_t rnti, double rsrp, double sinr, uint8_t componentCarrierId)
+{
+    NetStateEntry &entry = watched->monitor->m_entries[watched->vehicleId];
+    // spectral efficiency at the target BER, as LteAmc computes it per RB
+    double efficiency = std::log2(1.0 + sinr / (-std::log(5.0 * AMC_BER) / 1.5));
+
+    entry.rsrpDbm = 10 * std::log10(rsrp) + 30;
+    entry.sinrDb = 10 * std::log10(sinr);
+    entry.cqi = watched->monitor->m_amc->GetCqiFromSpectralEfficiency(efficiency);
+    entry.cell = cellId;
+    entry.valid |= NET_STATE_VALID_RADIO | NET_STATE_VALID_CELL;
+}
+/* only frames from the associated AP count */
+void NetStateMonitor::snifferRx(Watched *watched, Ptr<const Packet> packet, uint16_t channelFreqMhz, WifiTxVector txVector,
+    MpduInfo aMpdu, SignalNoiseDbm signalNoise, uint16_t staId)
+{
+    NetStateMonitor *monitor = watched->monitor;
+    NetStateEntry &entry = monitor->m_entries[watched->vehicleId];
+    Ptr<StaWifiMac> mac = DynamicCast<StaWifiMac>(watched->sta->GetMac());
+    WifiMacHeader hdr;
+
+    if(!mac || !mac->IsAssociated() || !packet->PeekHeader(hdr) || hdr.GetAddr2() != mac->GetBssid()){
+        return;
+    }
+
+    entry.rssiDbm = signalNoise.signal;
+    WifiMode mode = txVector.GetMode();
+    if(mode.GetModulationClass() >= WIFI_MOD_CLASS_HT){
+        entry.mcs = mode.GetMcsValue();
+    }
+    else{
+        double mbps = mode.GetDataRate(txVector) / 1e6;
+        const double *rate = std::find(std::begin(ofdmRates), std::end(ofdmRates), mbps);
+        entry.mcs = (rate == std::end(ofdmRates)) ? NET_STATE_NO_MCS : rate - std::begin(ofdmRates);
+    }
+    entry.valid |= NET_STATE_VALID_RADIO;
+
+    auto ap = std::find(monitor->m_aps.begin(), monitor->m_aps.end(), hdr.GetAddr2());
+    if(ap != monitor->m_aps.end()){
+        entry.cell = ap - monitor->m_aps.begin();
+        entry.valid |= NET_STATE_VALID_CELL;
+    }
+}
+void NetStateMonitor::cwnd(Watched *watched, uint32_t oldValue, uint32_t newValue)
+{
+    NetStateEntry &entry = watched->monitor->m_entries[watched->vehicleId];
+    entry.cwnd = newValue;
+    entry.valid |= NET_STATE_VALID_TCP;
+}
+void NetStateMonitor::rtt(Watched *watched, Time oldValue, Time newValue)
+{
+    NetStateEntry &entry = watched->monitor->m_entries[watched->vehicleId];
+    entry.rttMs = newValue.GetSeconds() * 1000;
+    entry.valid |= NET_STATE_VALID_TCP;
+}
+
+zmq::message_t NetStateMonitor::frame(uint32_t tick, Ptr<GcsApp> &gcsApp, std::vector< Ptr<UavApp> > &uavsApp)
+{
+    NetStateHeader hdr;
+    hdr.type = CTRL_FRAME_NET_STATE;
+    hdr.magic = CTRL_FRAME_MAGIC;
+    hdr.flags = m_useWifi ? NET_STATE_FLAG_WIFI : 0;
+    hdr.count = m_entries.size();
+    hdr.tick = tick;
+    hdr.simTime = Simulator::Now().GetSeconds();
+    zmq::message_t message(sizeof(hdr) + m_entries.size() * sizeof(NetStateEntry));
+    uint8_t *p = static_cast<uint8_t*>(message.data());
+
+    for(std::size_t i = 0; i < m_entries.size(); i++){
+        NetStateEntry &entry = m_entries[i];
+        if(m_sockets[i]){
+            entry.bytesQueued = m_sndBufSizes[i] - std::min(m_sndBufSizes[i], m_sockets[i]->GetTxAvailable());
+        }
+        entry.bytesUp = gcsApp->getRxBytes(i);
+        entry.bytesDown = (i < uavsApp.size()) ? uavsApp[i]->getRxBytes() : 0;
+    }
+    memcpy(p, &hdr, sizeof(hdr));
+    memcpy(p + sizeof(hdr), m_entries.data(), m_entries.size() * sizeof(NetStateEntry));
+    return message;
+}
@@ -0,0 +1,65 @@
+#ifndef INCLUDE_NETSTATEMONITOR_H
+#define INCLUDE_NETSTATEMONITOR_H
+
+// std includes
+#include <vector>
+#include <memory>
+// ns3 includes
+#include "ns3/core-module.h"
+#include "ns3/network-module.h"
+#include "ns3/internet-module.h"
+#include "ns3/lte-module.h"
+#include "ns3/wifi-module.h"
+// zmq includes
+#include <zmq.hpp>
+// custom includes
+#include "wireFormat.h"
+#include "gcsApp.h"
+#include "uavApp.h"
+
+using namespace std;
+using namespace ns3;
+
+/*
+* Link metrics of every UAV for AirSim's network aware controllers. Radio and
+* TCP values are kept up to date from ns-3 trace sources as they fire, byte
+* counters are read from the apps when a frame is built, once per tick.
+*/
+class NetStateMonitor
+{
+public:
+    NetStateMonitor(std::size_t numOfUav, bool useWifi);
+
+    // hook the UE PHY, RSRP/SINR are reported every CQI period
+    void watchLte(uint16_t vehicleId, Ptr<NetDevice> ueDevice);
+    // hook the STA PHY, apDevices give the AP indexes
+    void watchWifi(uint16_t vehicleId, Ptr<NetDevice> staDevice, const NetDeviceContainer &apDevices);
+    // hook the UAV -> GCS socket, sndBufSize is its TCP send buffer
+    void watchTcp(uint16_t vehicleId, Ptr<Socket> socket, uint32_t sndBufSize);
+
+    // | NetStateHeader | count * NetStateEntry |
+    zmq::message_t frame(uint32_t tick, Ptr<GcsApp> &gcsApp, std::vector< Ptr<UavApp> > &uavsApp);
+private:
+    struct Watched
+    {
+        NetStateMonitor *monitor;
+        uint16_t vehicleId;
+        Ptr<WifiNetDevice> sta; // Wifi only
+    };
+
+    static void rsrpSinr(Watched *watched, uint16_t cellId, uint16_t rnti, double rsrp, double sinr, uint8_t componentCarrierId);
+    static void snifferRx(Watched *watched, Ptr<const Packet> packet, uint16_t channelFreqMhz, WifiTxVector txVector,
+        MpduInfo aMpdu, SignalNoiseDbm signalNoise, uint16_t staId);
+    static void cwnd(Watched *watched, uint32_t oldValue, uint32_t newValue);
+    static void rtt(Watched *watched, Time oldValue, Time newValue);
+
+    bool m_useWifi;
+    Ptr<LteAmc> m_amc; // SINR to CQI
+    std::vector<NetStateEntry> m_entries; // indexed by vehicle id
+    std::vector<Ptr<Socket>> m_sockets;
+    std::vector<uint32_t> m_sndBufSizes;
+    std::vector<Mac48Address> m_aps; // index is the cell reported for Wifi
+    std::vector< std::unique_ptr<Watched> > m_watched; // trace callback contexts
+};
+
+#endif
@@ -0,0 +1,140 @@
+// std includes
+#include <cstring>
+// posix includes
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+// ns3 includes
+#include "ns3/core-module.h"
+// custom includes
+#include "sessionLog.h"
+
+using namespace std;
+using namespace ns3;
+
+NS_LOG_COMPONENT_DEFINE ("SessionLog");
+
+#define SESSION_LOG_ALIGN (8)
+#define SESSION_LOG_BUFFER (1 << 20)
+
+static std::size_t padded(std::size_t size)
+{
+    return (size + SESSION_LOG_ALIGN - 1) / SESSION_LOG_ALIGN * SESSION_LOG_ALIGN;
+}
+
+SessionLog::SessionLog(const std::string &path, Mode mode): m_mode(mode)
+{
+    std::size_t magicSize = strlen(SESSION_LOG_MAGIC);
+
+    if(m_mode == RECORD){
+        m_file = fopen(path.c_str(), "wb");
+        if(!m_file){
+            NS_FATAL_ERROR("[SessionLog] cannot create " << path);
+        }
+        setvbuf(m_file, nullptr, _IOFBF, SESSION_LOG_BUFFER);
+        fwrite(SESSION_LOG_MAGIC, 1, magicSize, m_file);
+        return;
+    }
+
+    struct stat st;
+    int fd = open(path.c_str(), O_RDONLY);
+    if(fd < 0 || fstat(fd, &st) != 0){
+        NS_FATAL_ERROR("[SessionLog] cannot open " << path);
+    }
+    m_size = st.st_size;
+    if(m_size < magicSize){
+        NS_FATAL_ERROR("[SessionLog] " << path << " is not a session log");
+    }
+    void *p = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(p == MAP_FAILED){
+        NS_FATAL_ERROR("[SessionLog] cannot map " << path);
+    }
+    m_base = static_cast<const uint8_t*>(p);
+    if(memcmp(m_base, SESSION_LOG_MAGIC, magicSize) != 0){
+        NS_FATAL_ERROR("[SessionLog] " << path << " is not a session log");
+    }
+    m_cursor = magicSize;
+}
+SessionLog::~SessionLog()
+{
+    if(m_file){
+        fclose(m_file);
+    }
+    if(m_base){
+        munmap(const_cast<uint8_t*>(m_base), m_size);
+    }
+}
+
+void SessionLog::setTick(uint32_t tick)
+{
+    m_tick = tick;
+    if(m_file){
+        // a crashed run still leaves every completed tick behind
+        fflush(m_file);
+    }
+}
+
+void SessionLog::write(uint16_t type, uint16_t channel, const void *data, std::size_t size)
+{
+    write(type, channel, nullptr, 0, data, size);
+}
+void SessionLog::write(uint16_t type, uint16_t channel, const void *head, std::size_t headSize, const void *data, std::size_t size)
+{
+    static const uint8_t zeros[SESSION_LOG_ALIGN] = {0};
+    LogRecordHeader hdr;
+
+    if(!m_file){
+        return;
+    }
+    hdr.type = type;
+    hdr.channel = channel;
+    hdr.tick = m_tick;
+    hdr.size = headSize + size;
+    fwrite(&hdr, sizeof(hdr), 1, m_file);
+    if(headSize){
+        fwrite(head, 1, headSize, m_file);
+    }
+    if(size){
+        fwrite(data, 1, size, m_file);
+    }
+    fwrite(zeros, 1, padded(hdr.size) - hdr.size, m_file);
+}
+
+bool SessionLog::read(uint16_t type, uint16_t channel, const uint8_t *&data, std::size_t &size)
+{
+    LogRecordHeader hdr;
+
+    if(m_cursor + sizeof(hdr) > m_size){
+        return false;
+    }
+    memcpy(&hdr, m_base + m_cursor, sizeof(hdr));
+    if(hdr.type != type || hdr.channel != channel){
+        return false;
+    }
+    if(m_cursor + sizeof(hdr) + hdr.size > m_size){
+        NS_LOG_WARN("[SessionLog] truncated record at tick " << hdr.tick);
+        m_cursor = m_size;
+        return false;
+    }
+    if(hdr.tick != m_tick){
+        NS_LOG_WARN("[SessionLog] record of tick " << hdr.tick << " replayed at tick " << m_tick);
+    }
+    data = m_base + m_cursor + sizeof(hdr);
+    size = hdr.size;
+    m_cursor += sizeof(hdr) + padded(hdr.size);
+    return true;
+}
+bool SessionLog::skip(void)
+{
+    LogRecordHeader hdr;
+
+    if(m_cursor + sizeof(hdr) > m_size){
+        return false;
+    }
+    memcpy(&hdr, m_base + m_cursor, sizeof(hdr));
+    NS_LOG_WARN("[SessionLog] skip record type " << hdr.type << " of tick " << hdr.tick);
+    m_cursor += sizeof(hdr) + padded(hdr.size);
+    return true;
+}
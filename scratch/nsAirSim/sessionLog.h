@@ -0,0 +1,86 @@
+#ifndef INCLUDE_SESSIONLOG_H
+#define INCLUDE_SESSIONLOG_H
+
+// std includes
+#include <string>
+#include <cstdio>
+#include <cstdint>
+#include <cstddef>
+
+using namespace std;
+
+// record types
+#define LOG_NET_CONFIG (1) // NetConfig blob as sent by AirSim
+#define LOG_CTRL (2) // control message ending AirSim's turn (tick, pose frame, bye)
+#define LOG_POSES (3) // LogPose per UAV in id order, fetched by RPC
+#define LOG_MSG (4) // | MsgHeader | payload | received on a ZmqMux
+
+// LOG_MSG channels
+#define LOG_CHANNEL_UAV (0)
+#define LOG_CHANNEL_GCS (1)
+
+#define SESSION_LOG_MAGIC ("NSASLOG1")
+
+#pragma pack(push, 1)
+/*
+* | magic(8) | record | record | ...
+* record: | LogRecordHeader | payload | padding to 8 bytes |
+* so that a memory mapped log can be walked without copying
+*/
+struct LogRecordHeader
+{
+    uint16_t type;
+    uint16_t channel;
+    uint32_t tick;
+    uint64_t size; // payload bytes, without padding
+};
+struct LogPose
+{
+    float pos[3];
+    float vel[3];
+    float acc[3];
+};
+#pragma pack(pop)
+
+/*
+* Append-only log of everything AirSim feeds into ns during a session.
+* Recording writes records as they are received; replay memory maps the
+* file and hands records back in the same order, so the same run can be
+* repeated deterministically without AirSim.
+*/
+class SessionLog
+{
+public:
+    enum Mode {RECORD, REPLAY};
+
+    SessionLog(const std::string &path, Mode mode);
+    ~SessionLog();
+
+    bool isReplay(void) const {return m_mode == REPLAY;}
+    // also flushes the records of the previous tick when recording
+    void setTick(uint32_t tick);
+    uint32_t getTick(void) const {return m_tick;}
+
+    void write(uint16_t type, uint16_t channel, const void *data, std::size_t size);
+    // head and data are stored back to back as one record
+    void write(uint16_t type, uint16_t channel, const void *head, std::size_t headSize, const void *data, std::size_t size);
+
+    // consume the next record if it has this type and channel
+    bool read(uint16_t type, uint16_t channel, const uint8_t *&data, std::size_t &size);
+    // drop the next record, false at the end of the log
+    bool skip(void);
+    bool atEnd(void) const {return m_cursor >= m_size;}
+private:
+    Mode m_mode;
+    uint32_t m_tick = 0;
+
+    // record
+    FILE *m_file = nullptr;
+
+    // replay
+    const uint8_t *m_base = nullptr;
+    std::size_t m_size = 0;
+    std::size_t m_cursor = 0;
+};
+
+#endif
@@ -0,0 +1,70 @@
+#ifndef INCLUDE_SPSCQUEUE_H
+#define INCLUDE_SPSCQUEUE_H
+
+// std includes
+#include <vector>
+#include <atomic>
+#include <cstddef>
+
+using namespace std;
+
+/*
+* Bounded lock-free queue between exactly one producer thread and one
+* consumer thread. Items are moved in and consumed in place through front(),
+* so nothing is copied or allocated once the ring exists.
+*/
+template <typename T>
+class SpscQueue
+{
+public:
+    // capacity is rounded up to a power of two
+    explicit SpscQueue(std::size_t capacity = 1024): m_head(0), m_tail(0)
+    {
+        std::size_t size = 1;
+        while(size < capacity){
+            size <<= 1;
+        }
+        m_ring.resize(size);
+        m_mask = size - 1;
+    }
+
+    // producer, false when full
+    bool push(T &&item)
+    {
+        std::size_t head = m_head.load(std::memory_order_relaxed);
+        if(head - m_tail.load(std::memory_order_acquire) > m_mask){
+            return false;
+        }
+        m_ring[head & m_mask] = std::move(item);
+        m_head.store(head + 1, std::memory_order_release);
+        return true;
+    }
+    // consumer, nullptr when empty, valid until pop()
+    T* front(void)
+    {
+        std::size_t tail = m_tail.load(std::memory_order_relaxed);
+        if(tail == m_head.load(std::memory_order_acquire)){
+            return nullptr;
+        }
+        return &m_ring[tail & m_mask];
+    }
+    // consumer, only after front() returned an item
+    void pop(void)
+    {
+        std::size_t tail = m_tail.load(std::memory_order_relaxed);
+        m_ring[tail & m_mask] = T();
+        m_tail.store(tail + 1, std::memory_order_release);
+    }
+    bool empty(void) const
+    {
+        return m_tail.load(std::memory_order_acquire) == m_head.load(std::memory_order_acquire);
+    }
+private:
+    std::vector<T> m_ring;
+    std::size_t m_mask;
+    // on separate cache lines, each is written by one side only
+    alignas(64) std::atomic<std::size_t> m_head; // next slot the producer writes
+    alignas(64) std::atomic<std::size_t> m_tail; // next slot the consumer reads
+};
+
+#endif
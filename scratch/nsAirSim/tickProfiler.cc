@@ -0,0 +1,174 @@
+// std includes
+#include <iostream>
+#include <cstring>
+// posix includes
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+// ns3 includes
+#include "ns3/core-module.h"
+// zmq includes
+#include <zmq.hpp>
+// custom includes
+#include "tickProfiler.h"
+
+using namespace std;
+using namespace ns3;
+
+NS_LOG_COMPONENT_DEFINE ("TickProfiler");
+
+static const char *phaseName[PHASE_COUNT + 1] = {"reporting", "AirSim wait", "mobility", "GCS drain", "UAV drain", "ns events"};
+
+TickProfiler::TickProfiler(zmq::context_t &context, int pubPort, const std::string &ringPath, uint32_t ringSlots, double budget):
+    m_budget(budget), m_tickStart(0), m_tick(0), m_phase(PHASE_COUNT), m_warnedTick(0)
+{
+    memset(&m_sample, 0, sizeof(m_sample));
+
+    if(pubPort > 0){
+        m_pub = zmq::socket_t(context, ZMQ_PUB);
+        m_pub.bind("tcp://*:" + to_string(pubPort));
+        m_hasPub = true;
+    }
+
+    if(!ringPath.empty() && ringSlots > 0){
+        m_ringSize = sizeof(TickRingHeader) + (std::size_t)ringSlots * sizeof(TickSample);
+        int fd = open(ringPath.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+        if(fd < 0 || ftruncate(fd, m_ringSize) != 0){
+            NS_FATAL_ERROR("[TickProfiler] cannot create " << ringPath);
+        }
+        void *p = mmap(nullptr, m_ringSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        close(fd);
+        if(p == MAP_FAILED){
+            NS_FATAL_ERROR("[TickProfiler] cannot map " << ringPath);
+        }
+        m_ring = static_cast<TickRingHeader*>(p);
+        memcpy(m_ring->magic, TICK_RING_MAGIC, sizeof(m_ring->magic));
+        m_ring->slots = ringSlots;
+        m_ring->sampleSize = sizeof(TickSample);
+        m_ring->head = 0;
+    }
+
+    if(m_budget > 0){
+        m_watchdog = std::thread(&TickProfiler::watchdog, this);
+    }
+}
+TickProfiler::~TickProfiler()
+{
+    if(m_watchdog.joinable()){
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stop = true;
+        }
+        m_cv.notify_one();
+        m_watchdog.join();
+    }
+    if(m_ring){
+        munmap(m_ring, m_ringSize);
+    }
+    if(m_hasPub){
+        m_pub.close();
+    }
+}
+
+void TickProfiler::setMuxes(const ZmqMux *gcsMux, const ZmqMux *uavMux)
+{
+    m_gcsMux = gcsMux;
+    m_uavMux = uavMux;
+}
+
+static int64_t sinceEpochNs(std::chrono::steady_clock::time_point t)
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(t.time_since_epoch()).count();
+}
+
+uint32_t TickProfiler::elapsedUs(Clock::time_point from, Clock::time_point to) const
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(to - from).count();
+}
+
+void TickProfiler::beginTick(uint32_t tick, double simTime)
+{
+    Clock::time_point now = Clock::now();
+    uint64_t events = Simulator::GetEventCount();
+
+    // the previous tick missed its budget between two watchdog polls
+    if(m_budget > 0 && m_tickStart.load() != 0 && m_warnedTick.load() != m_tick.load() + 1){
+        double seconds = (sinceEpochNs(now) - m_tickStart.load()) * 1e-9;
+        if(seconds > m_budget){
+            std::cerr << "[TickProfiler] tick " << m_tick.load() << " took " << seconds << " s, budget " << m_budget << " s" << std::endl;
+        }
+    }
+
+    memset(&m_sample, 0, sizeof(m_sample));
+    m_sample.tick = tick;
+    m_sample.simTime = simTime;
+    if(m_hasLastEnd){
+        m_sample.eventsUs = elapsedUs(m_lastEnd, now);
+        m_sample.events = events - m_lastEvents;
+    }
+    m_lastEvents = events;
+    m_mark = now;
+
+    // the watchdog skips while m_tickStart is 0
+    m_tickStart = 0;
+    m_tick = tick;
+    m_phase = PHASE_REPORT;
+    m_tickStart = sinceEpochNs(now);
+}
+void TickProfiler::mark(TickPhase phase)
+{
+    Clock::time_point now = Clock::now();
+
+    m_sample.phaseUs[phase] = elapsedUs(m_mark, now);
+    m_mark = now;
+    m_phase = phase + 1;
+}
+void TickProfiler::endTick(void)
+{
+    if(m_gcsMux){
+        m_sample.gcsDepth = m_gcsMux->getDrained() - m_lastGcsDrained;
+        m_lastGcsDrained = m_gcsMux->getDrained();
+    }
+    if(m_uavMux){
+        m_sample.uavDepth = m_uavMux->getDrained() - m_lastUavDrained;
+        m_lastUavDrained = m_uavMux->getDrained();
+    }
+    m_lastEnd = Clock::now();
+    m_hasLastEnd = true;
+    m_phase = PHASE_COUNT;
+    publish(m_sample);
+}
+
+void TickProfiler::publish(const TickSample &sample)
+{
+    if(m_hasPub){
+        zmq::message_t message(&sample, sizeof(sample));
+        m_pub.send(message, zmq::send_flags::dontwait);
+    }
+    if(m_ring){
+        TickSample *slots = reinterpret_cast<TickSample*>(m_ring + 1);
+        memcpy(&slots[m_ring->head % m_ring->slots], &sample, sizeof(sample));
+        m_ring->head++;
+    }
+}
+
+// polls at a quarter of the budget, so a stall is reported while it lasts
+void TickProfiler::watchdog(void)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    auto period = std::chrono::duration<double>(m_budget / 4);
+
+    while(!m_cv.wait_for(lock, period, [this]{return m_stop;})){
+        int64_t start = m_tickStart.load();
+        uint32_t tick = m_tick.load();
+        if(start == 0 || m_warnedTick.load() == tick + 1){
+            continue;
+        }
+        double seconds = (sinceEpochNs(Clock::now()) - start) * 1e-9;
+        if(seconds > m_budget){
+            m_warnedTick = tick + 1;
+            std::cerr << "[TickProfiler] tick " << tick << " running for " << seconds << " s in " << phaseName[m_phase.load()]
+                << ", budget " << m_budget << " s" << std::endl;
+        }
+    }
+}
@@ -0,0 +1,117 @@
+#ifndef INCLUDE_TICKPROFILER_H
+#define INCLUDE_TICKPROFILER_H
+
+// std includes
+#include <string>
+#include <chrono>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <cstdint>
+// zmq includes
+#include <zmq.hpp>
+// custom includes
+#include "zmqMux.h"
+
+using namespace std;
+
+// phases of AirSimSync::takeTurn, in order
+enum TickPhase
+{
+    PHASE_REPORT = 0, // net state frame, flow and latency samples, grant
+    PHASE_WAIT, // blocked on AirSim's end of turn
+    PHASE_MOBILITY, // pose frame or mobilityUpdateDirect
+    PHASE_GCS_DRAIN,
+    PHASE_UAV_DRAIN,
+    PHASE_COUNT
+};
+
+#define TICK_RING_MAGIC ("NSASTICK")
+
+#pragma pack(push, 1)
+/*
+* One sample per tick, published as is on the PUB socket and stored in the ring file.
+* Times are wall clock microseconds.
+*/
+struct TickSample
+{
+    uint32_t tick;
+    float simTime; // s
+    uint32_t phaseUs[PHASE_COUNT];
+    uint32_t eventsUs; // ns-3 events run since the previous tick returned
+    uint32_t events; // number of those events
+    uint32_t gcsDepth; // messages drained from the GCS mux
+    uint32_t uavDepth; // messages drained from the UAV mux
+};
+/*
+* | TickRingHeader | slots * TickSample |
+* sample n is at slot n % slots, head is the number of samples ever written
+*/
+struct TickRingHeader
+{
+    char magic[8];
+    uint32_t slots;
+    uint32_t sampleSize;
+    uint64_t head;
+};
+#pragma pack(pop)
+
+/*
+* Wall clock timing of every tick for long runs where NS_LOG_INFO is far too
+* slow. Costs a few clock reads per tick; samples go to an optional PUB socket
+* and/or a memory mapped ring file that survives a crash. A watchdog thread
+* warns on stderr when a tick runs past its wall time budget, including a
+* tick stuck waiting on AirSim.
+*/
+class TickProfiler
+{
+public:
+    // pubPort 0 and an empty ringPath disable that output, budget 0 disables the watchdog
+    TickProfiler(zmq::context_t &context, int pubPort, const std::string &ringPath, uint32_t ringSlots, double budget);
+    ~TickProfiler();
+
+    // queue depths are the per-tick drain counts of these
+    void setMuxes(const ZmqMux *gcsMux, const ZmqMux *uavMux);
+
+    void beginTick(uint32_t tick, double simTime);
+    // close phase, it ran from the previous mark
+    void mark(TickPhase phase);
+    void endTick(void);
+private:
+    typedef std::chrono::steady_clock Clock;
+
+    uint32_t elapsedUs(Clock::time_point from, Clock::time_point to) const;
+    void publish(const TickSample &sample);
+    void watchdog(void);
+
+    TickSample m_sample;
+    Clock::time_point m_mark;
+    Clock::time_point m_lastEnd;
+    bool m_hasLastEnd = false;
+    uint64_t m_lastEvents = 0;
+
+    const ZmqMux *m_gcsMux = nullptr;
+    const ZmqMux *m_uavMux = nullptr;
+    uint64_t m_lastGcsDrained = 0;
+    uint64_t m_lastUavDrained = 0;
+
+    zmq::socket_t m_pub;
+    bool m_hasPub = false;
+
+    TickRingHeader *m_ring = nullptr;
+    std::size_t m_ringSize = 0;
+
+    // watchdog
+    double m_budget;
+    std::atomic<int64_t> m_tickStart; // ns since the clock epoch, 0 between ticks
+    std::atomic<uint32_t> m_tick;
+    std::atomic<int> m_phase;
+    std::atomic<uint32_t> m_warnedTick; // tick + 1 of the last warning
+    bool m_stop = false;
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+    std::thread m_watchdog;
+};
+
+#endif
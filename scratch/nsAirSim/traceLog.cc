@@ -0,0 +1,102 @@
+// std includes
+#include <cstring>
+#include <chrono>
+#include <algorithm>
+// ns3 includes
+#include "ns3/core-module.h"
+// custom includes
+#include "traceLog.h"
+
+using namespace std;
+using namespace ns3;
+
+NS_LOG_COMPONENT_DEFINE ("TraceLog");
+
+#define TRACE_WRITER_SLEEP_US (1000)
+
+TraceLog *TraceLog::s_instance = nullptr;
+
+TraceLog::TraceLog(const std::string &path, std::size_t capacity): m_head(0), m_tail(0), m_stop(false)
+{
+    std::size_t size = 1;
+    uint32_t recordSize = sizeof(TraceRecord);
+    uint32_t reserved = 0;
+
+    while(size < capacity){
+        size <<= 1;
+    }
+    m_ring.resize(size);
+    m_mask = size - 1;
+
+    m_file = fopen(path.c_str(), "wb");
+    if(!m_file){
+        NS_FATAL_ERROR("[TraceLog] cannot create " << path);
+    }
+    fwrite(TRACE_MAGIC, 1, strlen(TRACE_MAGIC), m_file);
+    fwrite(&recordSize, sizeof(recordSize), 1, m_file);
+    fwrite(&reserved, sizeof(reserved), 1, m_file);
+
+    if(s_instance){
+        NS_FATAL_ERROR("[TraceLog] only one trace can be open");
+    }
+    s_instance = this;
+    m_writer = std::thread(&TraceLog::writer, this);
+}
+TraceLog::~TraceLog()
+{
+    s_instance = nullptr;
+    m_stop = true;
+    m_writer.join();
+    // whatever the writer had not seen yet
+    flush();
+    fclose(m_file);
+    if(m_dropped){
+        NS_LOG_WARN("[TraceLog] dropped " << m_dropped << " records, the writer could not keep up");
+    }
+}
+
+void TraceLog::push(uint16_t type, uint32_t nodeId, uint16_t peer, uint32_t bytes, int32_t result)
+{
+    std::size_t head = m_head.load(std::memory_order_relaxed);
+
+    if(head - m_tail.load(std::memory_order_acquire) > m_mask){
+        m_dropped++;
+        return;
+    }
+    TraceRecord &record = m_ring[head & m_mask];
+    record.timeNs = Simulator::Now().GetNanoSeconds();
+    record.tick = m_tick;
+    record.nodeId = nodeId;
+    record.bytes = bytes;
+    record.result = result;
+    record.type = type;
+    record.peer = peer;
+    record.reserved = 0;
+    m_head.store(head + 1, std::memory_order_release);
+}
+
+std::size_t TraceLog::flush(void)
+{
+    std::size_t tail = m_tail.load(std::memory_order_relaxed);
+    std::size_t head = m_head.load(std::memory_order_acquire);
+    std::size_t count = head - tail;
+
+    while(tail != head){
+        // contiguous run up to the end of the ring
+        std::size_t first = tail & m_mask;
+        std::size_t n = std::min(head - tail, m_ring.size() - first);
+        fwrite(&m_ring[first], sizeof(TraceRecord), n, m_file);
+        tail += n;
+        m_tail.store(tail, std::memory_order_release);
+    }
+    return count;
+}
+
+void TraceLog::writer(void)
+{
+    while(!m_stop.load()){
+        if(flush() == 0){
+            std::this_thread::sleep_for(std::chrono::microseconds(TRACE_WRITER_SLEEP_US));
+        }
+    }
+}
@@ -0,0 +1,89 @@
+#ifndef INCLUDE_TRACELOG_H
+#define INCLUDE_TRACELOG_H
+
+// std includes
+#include <string>
+#include <cstdio>
+#include <cstdint>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+// trace event types, keep in sync with decodeTrace.py
+#define TRACE_GCS_ACCEPT (1)
+#define TRACE_GCS_AUTH (2) // peer is the vehicle id given to the connection
+#define TRACE_GCS_SEND (3) // peer is the destination vehicle id
+#define TRACE_GCS_RECV (4) // peer is the source vehicle id
+#define TRACE_UAV_SEND (5)
+#define TRACE_UAV_RECV (6)
+#define TRACE_CONG_SEND (7)
+#define TRACE_CONG_RECV (8)
+
+#define TRACE_MAGIC ("NSASTRC1")
+
+#pragma pack(push, 1)
+/*
+* | magic(8) | uint32 record size | uint32 reserved | TraceRecord | TraceRecord | ...
+*/
+struct TraceRecord
+{
+    int64_t timeNs; // simulation time
+    uint32_t tick;
+    uint32_t nodeId;
+    uint32_t bytes;
+    int32_t result; // Send() result, 0 for receptions
+    uint16_t type;
+    uint16_t peer; // vehicle id on the other end, 0xFFFF if unknown
+    uint32_t reserved;
+};
+#pragma pack(pop)
+
+/*
+* Binary per-packet trace. The simulator thread only copies a fixed size
+* record into a lock-free single producer single consumer ring, a background
+* thread writes the ring out. When the writer falls behind records are
+* dropped and counted instead of stalling the simulation.
+* Decode with decodeTrace.py.
+*/
+class TraceLog
+{
+public:
+    // capacity is rounded up to a power of two
+    TraceLog(const std::string &path, std::size_t capacity = 1 << 16);
+    ~TraceLog();
+
+    // the log every app writes to, nullptr when tracing is off
+    static TraceLog* Get(void) {return s_instance;}
+    static void setTick(uint32_t tick) {if(s_instance){s_instance->m_tick = tick;}}
+    // no-op when tracing is off
+    static void trace(uint16_t type, uint32_t nodeId, uint16_t peer, uint32_t bytes, int32_t result = 0)
+    {
+        if(s_instance){
+            s_instance->push(type, nodeId, peer, bytes, result);
+        }
+    }
+
+    uint64_t getDropped(void) const {return m_dropped;}
+private:
+    void push(uint16_t type, uint32_t nodeId, uint16_t peer, uint32_t bytes, int32_t result);
+    void writer(void);
+    // write out everything between tail and head, returns the number of records
+    std::size_t flush(void);
+
+    static TraceLog *s_instance;
+
+    FILE *m_file;
+    std::vector<TraceRecord> m_ring;
+    std::size_t m_mask;
+    std::atomic<std::size_t> m_head; // next slot the simulator writes
+    std::atomic<std::size_t> m_tail; // next slot the writer reads
+    uint32_t m_tick = 0;
+    uint64_t m_dropped = 0;
+
+    std::atomic<bool> m_stop;
+    std::thread m_writer;
+};
+
+#endif
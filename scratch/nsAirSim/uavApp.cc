@@ -24,6 +24,7 @@ STRICT_MODE_ON
 // custom includes
 #include "uavApp.h"
 #include "AirSimSync.h"
+#include "traceLog.h"
 
 using namespace std;
 using namespace ns3;
@@ -50,20 +51,27 @@ TypeId UavApp::GetTypeId(void)
     return tid;
 }
 
-/* Init ns stuff, rPC client connection and zmq socket init, connect */
-void UavApp::Setup(zmq::context_t &context, Ptr<Socket> socket, Address myAddress, Address peerAddress,
-    int zmqRecvPort, int zmqSendPort, std::string name
+/* Init ns stuff and attach to the shared zmq mux */
+void UavApp::Setup(ZmqMux *mux, uint16_t id, Ptr<Socket> socket, Address myAddress, Address peerAddress,
+    std::string name, PayloadStore *payloadStore, MsgLatency *msgLatency
 )
 {
+    m_payloadStore = payloadStore;
+    m_msgLatency = msgLatency;
     m_name = name;
+    m_id = id;
+    m_mux = mux;
     m_socket = socket;
     m_address = myAddress;
     m_peerAddress = peerAddress;
+}
 
-    m_zmqSocketSend = zmq::socket_t(context, ZMQ_PUSH);
-    m_zmqSocketSend.bind("tcp://*:" + to_string(zmqSendPort));
-    m_zmqSocketRecv = zmq::socket_t(context, ZMQ_REP);
-    m_zmqSocketRecv.connect("tcp://localhost:" + to_string(zmqRecvPort));
+void UavApp::setUdp(uint32_t udpClasses, Address udpAddress, Address udpPeerAddress, uint32_t udpMaxPayload)
+{
+    m_udpClasses = udpClasses;
+    m_udpAddress = udpAddress;
+    m_udpPeerAddress = udpPeerAddress;
+    m_udpMaxPayload = udpMaxPayload;
 }
 
 /* Bind ns sockets and logging*/
@@ -77,13 +85,23 @@ void UavApp::StartApplication(void)
         NS_FATAL_ERROR("UAV connect error");
     };
     
-    /* @@ We may leave the job to application */
     // send my name
-    std::string s = "name " + m_name + " ";
-    Ptr<Packet> packet = Create<Packet>((const uint8_t*)(s.c_str()), s.size()+1);
-    if(m_socket->Send(packet) == -1){
+    Ptr<Packet> packet = Create<Packet>((const uint8_t*)(m_name.c_str()), m_name.size());
+    if(m_socket->Send(MsgFramer::frame(packet, FRAME_HELLO)) == -1){
         NS_FATAL_ERROR(m_name << " sends my name Error");
     }
+    // the GCS tells UAVs apart by address, no handshake
+    if(m_udpClasses){
+        m_udpSocket = Socket::CreateSocket(GetNode(), UdpSocketFactory::GetTypeId());
+        if(m_udpSocket->Bind(m_udpAddress) != 0 || m_udpSocket->Connect(m_udpPeerAddress) != 0){
+            NS_FATAL_ERROR(m_name << " UDP bind or connect error");
+        }
+        m_udpSocket->SetRecvCallback(MakeCallback(&UavApp::recvUdpCallback, this));
+        if(m_payloadStore){
+            PayloadStore *store = m_payloadStore;
+            m_reassembler.setDropHandler([store](Ptr<Packet> fragment){store->release(fragment);});
+        }
+    }
 
     m_running = true;
     NS_LOG_INFO("[" << m_name << " starts]");
@@ -102,9 +120,10 @@ void UavApp::StopApplication(void)
     if(m_socket){
         m_socket->Close();
     }
-
-    m_zmqSocketSend.close();
-    m_zmqSocketRecv.close();
+    if(m_udpSocket){
+        m_udpSocket->Close();
+        NS_LOG_INFO("[" << m_name << "] gave up on " << m_reassembler.getDropped() << " incomplete UDP messages");
+    }
 
     NS_LOG_INFO("[" << m_name << " stopped]");
 }
@@ -119,55 +138,117 @@ void UavApp::Tx(Ptr<Socket> socket, std::string payload)
     }
 }
 
-/* <sim_time> <payload> */
-void UavApp::scheduleTx(void)
+/* <payload> */
+int UavApp::scheduleTx(zmq::message_t &message, Time delay, uint8_t msgClass)
 {
-    zmq::message_t message;
-    double now = Simulator::Now().GetSeconds();
-    zmq::recv_result_t res;
-
-    zmq::message_t rep(4);
-
     if(!m_running){
-        return;
+        return -1;
     }
 
     while(!m_events.empty() && !m_events.front().IsRunning()){
         m_events.pop();
     }
 
-    res = m_zmqSocketRecv.recv(message, zmq::recv_flags::dontwait);
-    while(res.has_value() && res.value() != -1){ // EAGAIN
-        int repRes = -1;
-        const uint8_t *payload = NULL;
-
-        payload = (const uint8_t*)message.data();
-        Ptr<Packet> packet = Create<Packet>((const uint8_t*)payload, message.size());
-        repRes = m_socket->Send(packet);
-
-        *(int*)rep.data() = repRes;
-        m_zmqSocketRecv.send(rep, zmq::send_flags::dontwait);
-        if(repRes < 0){
-            NS_LOG_INFO("time: " << now << " " << m_name << " sends " << packet->GetSize() << " bytes ERROR " << repRes);
+    Ptr<Packet> packet;
+    if(m_payloadStore && message.size()){
+        packet = m_payloadStore->store(message);
+    }
+    else{
+        packet = Create<Packet>((const uint8_t*)message.data(), message.size());
+    }
+    if(delay.IsStrictlyPositive()){
+        m_events.push(Simulator::Schedule(delay, &UavApp::sendPacket, this, packet, msgClass));
+        return 0;
+    }
+    return sendPacket(packet, msgClass);
+}
+int UavApp::sendPacket(Ptr<Packet> packet, uint8_t msgClass)
+{
+    double now = Simulator::Now().GetSeconds();
+    if(m_msgLatency){
+        m_msgLatency->stamp(packet);
+    }
+    uint32_t size = MsgFramer::messageSize(packet);
+    bool udp = m_udpSocket && msgClassUsesUdp(m_udpClasses, msgClass);
+    int repRes = udp ? sendDatagrams(packet, msgClass) : m_socket->Send(MsgFramer::frame(packet, FRAME_DATA, msgClass));
+    if(repRes > 0){
+        m_txBytes += repRes;
+        if(udp){
+            m_udpTxBytes += repRes;
         }
-        else{
-            NS_LOG_INFO("time: " << now << " " << m_name << " sends " << packet->GetSize() << " bytes");
+    }
+    TraceLog::trace(TRACE_UAV_SEND, GetNode()->GetId(), m_id, size, repRes);
+    if(repRes < 0){
+        NS_LOG_WARN("time: " << now << " " << m_name << " sends " << size << " bytes ERROR " << repRes);
+        if(m_payloadStore){
+            m_payloadStore->release(packet);
         }
+    }
+    return repRes;
+}
+int UavApp::sendDatagrams(Ptr<Packet> body, uint8_t msgClass)
+{
+    int sent = 0;
 
-        message.rebuild();
-        res = m_zmqSocketRecv.recv(message, zmq::recv_flags::dontwait);
+    for(auto &it:MsgReassembler::fragment(body, FRAME_DATA, msgClass, m_nextMsgId++, m_udpMaxPayload)){
+        int res = m_udpSocket->Send(it);
+        if(res < 0){
+            return res;
+        }
+        sent += res;
     }
+    return sent;
 }
-/* <from-address> <payload> then forward to application code */
+/* <from-address> <frames> then forward to application code */
 void UavApp::recvCallback(Ptr<Socket> socket)
 {
     Ptr<Packet> packet;
     Address from;
+
+    while((packet = socket->RecvFrom(from))){
+        m_rxBytes += packet->GetSize();
+        m_framer.feed(packet, [this](uint8_t type, uint8_t msgClass, Ptr<Packet> body){
+            recvFrame(type, msgClass, body);
+        });
+    }
+}
+/* <datagram> from the GCS */
+void UavApp::recvUdpCallback(Ptr<Socket> socket)
+{
+    Ptr<Packet> packet;
+    Address from;
+
+    while((packet = socket->RecvFrom(from))){
+        m_rxBytes += packet->GetSize();
+        m_udpRxBytes += packet->GetSize();
+        m_reassembler.feed(packet, [this](uint8_t type, uint8_t msgClass, Ptr<Packet> body){
+            recvFrame(type, msgClass, body);
+        });
+    }
+}
+void UavApp::recvFrame(uint8_t type, uint8_t msgClass, Ptr<Packet> body)
+{
     float now = Simulator::Now().GetSeconds();
-    packet = socket->RecvFrom(from);
 
-    zmq::message_t message(packet->GetSize());
-    packet->CopyData((uint8_t *)message.data(), packet->GetSize());
-    m_zmqSocketSend.send(message, zmq::send_flags::dontwait);
-    NS_LOG_INFO("time: " << now << ", [" << m_name << " recv]: " << (const char*)message.data());
-}
\ No newline at end of file
+    if(type != FRAME_DATA){
+        NS_LOG_WARN("time: " << now << ", [" << m_name << " recv]: unexpected frame type " << (int)type);
+        return;
+    }
+    if(m_msgLatency){
+        m_msgLatency->record(m_id, FLOW_DOWN, body);
+    }
+    if(m_payloadStore){
+        std::vector<zmq::message_t> done;
+        m_payloadStore->reassemble(body, done);
+        for(auto &it:done){
+            TraceLog::trace(TRACE_UAV_RECV, GetNode()->GetId(), m_id, it.size());
+            m_mux->send(m_id, it, msgClass);
+        }
+        return;
+    }
+
+    zmq::message_t message(body->GetSize());
+    body->CopyData((uint8_t *)message.data(), body->GetSize());
+    TraceLog::trace(TRACE_UAV_RECV, GetNode()->GetId(), m_id, body->GetSize());
+    m_mux->send(m_id, message, msgClass);
+}
@@ -13,6 +13,11 @@
 #include "ns3/stats-module.h"
 // zmq includes
 #include <zmq.hpp>
+// custom includes
+#include "zmqMux.h"
+#include "virtualPayload.h"
+#include "msgFramer.h"
+#include "msgLatency.h"
 
 using namespace std;
 using namespace ns3;
@@ -28,11 +33,22 @@ public:
     * \return The TypeId.
     */
     static TypeId GetTypeId(void);
-    void Setup(zmq::context_t &context, Ptr<Socket> socket, Address myAddress, Address peerAddress,
-        int zmqRecvPort, int zmqSendPort, std::string name
+    void Setup(ZmqMux *mux, uint16_t id, Ptr<Socket> socket, Address myAddress, Address peerAddress,
+        std::string name, PayloadStore *payloadStore = nullptr, MsgLatency *msgLatency = nullptr
     );
 
-    void scheduleTx(void);
+    // messages of the classes set in udpClasses go as datagrams from udpAddress to the GCS at udpPeerAddress
+    void setUdp(uint32_t udpClasses, Address udpAddress, Address udpPeerAddress, uint32_t udpMaxPayload);
+
+    // send one message of msgClass from AirSim delay from now, called by the mux dispatcher
+    // returns the Send() result, or 0 once a delayed send is scheduled
+    int scheduleTx(zmq::message_t &message, Time delay = Seconds(0), uint8_t msgClass = 0);
+    // bytes accepted by Send() and received, framing included
+    uint64_t getTxBytes(void) const {return m_txBytes;}
+    uint64_t getRxBytes(void) const {return m_rxBytes;}
+    // the UDP class share of those, datagrams may never arrive
+    uint64_t getUdpTxBytes(void) const {return m_udpTxBytes;}
+    uint64_t getUdpRxBytes(void) const {return m_udpRxBytes;}
 private:
     virtual void StartApplication (void);
     virtual void StopApplication (void);
@@ -40,7 +56,13 @@ private:
     // void Tx(Ptr<Socket> socket, Ptr<Packet> packet);
     void Tx(Ptr<Socket> socket, std::string payload);
 
+    int sendPacket(Ptr<Packet> packet, uint8_t msgClass);
+    // bytes sent, or the first failed Send() result
+    int sendDatagrams(Ptr<Packet> body, uint8_t msgClass);
+
     void recvCallback(Ptr<Socket> socket);
+    void recvUdpCallback(Ptr<Socket> socket);
+    void recvFrame(uint8_t type, uint8_t msgClass, Ptr<Packet> body);
 
     bool m_running = false;
     // ns stuff
@@ -48,11 +70,26 @@ private:
     Address         m_address;
     Address         m_peerAddress;
     std::queue<EventId> m_events;
+    MsgFramer m_framer;
+    // UDP classes, the socket is only created when some are set
+    uint32_t m_udpClasses = 0;
+    Ptr<Socket>     m_udpSocket;
+    Address         m_udpAddress;
+    Address         m_udpPeerAddress;
+    uint32_t m_udpMaxPayload = 0;
+    uint32_t m_nextMsgId = 0;
+    MsgReassembler m_reassembler;
+    uint64_t m_txBytes = 0;
+    uint64_t m_rxBytes = 0;
+    uint64_t m_udpTxBytes = 0;
+    uint64_t m_udpRxBytes = 0;
 
     // custom application member
     string m_name;
-    zmq::socket_t m_zmqSocketSend;
-    zmq::socket_t m_zmqSocketRecv;
+    uint16_t m_id; // index into NetConfig::uavsName
+    ZmqMux *m_mux; // shared by all UAVs, owned by main
+    PayloadStore *m_payloadStore; // size-only packets if set, owned by main
+    MsgLatency *m_msgLatency; // messages are stamped and timed if set, owned by main
 };
 
 #endif
\ No newline at end of file
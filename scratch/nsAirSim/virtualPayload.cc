@@ -0,0 +1,149 @@
+// std includes
+#include <utility>
+// ns3 includes
+#include "ns3/core-module.h"
+#include "ns3/network-module.h"
+// zmq includes
+#include <zmq.hpp>
+// custom includes
+#include "virtualPayload.h"
+
+using namespace std;
+using namespace ns3;
+
+NS_LOG_COMPONENT_DEFINE ("VirtualPayload");
+NS_OBJECT_ENSURE_REGISTERED (VirtualPayloadTag);
+
+VirtualPayloadTag::VirtualPayloadTag(): m_id(0), m_length(0)
+{
+}
+VirtualPayloadTag::VirtualPayloadTag(uint64_t id, uint32_t length): m_id(id), m_length(length)
+{
+}
+TypeId VirtualPayloadTag::GetTypeId(void)
+{
+    static TypeId tid = TypeId("VirtualPayloadTag")
+        .SetParent<Tag>()
+        .SetGroupName("ns3_AirSim")
+        .AddConstructor<VirtualPayloadTag>()
+    ;
+    return tid;
+}
+TypeId VirtualPayloadTag::GetInstanceTypeId(void) const
+{
+    return GetTypeId();
+}
+uint32_t VirtualPayloadTag::GetSerializedSize(void) const
+{
+    return sizeof(m_id) + sizeof(m_length);
+}
+void VirtualPayloadTag::Serialize(TagBuffer i) const
+{
+    i.WriteU64(m_id);
+    i.WriteU32(m_length);
+}
+void VirtualPayloadTag::Deserialize(TagBuffer i)
+{
+    m_id = i.ReadU64();
+    m_length = i.ReadU32();
+}
+void VirtualPayloadTag::Print(std::ostream &os) const
+{
+    os << "id=" << m_id << " length=" << m_length;
+}
+
+// hint owns the zmq message whose tail is being sent
+static void releaseMessage(void *data, void *hint)
+{
+    delete static_cast<zmq::message_t*>(hint);
+}
+
+PayloadStore::PayloadStore(Time maxAge): m_maxAge(maxAge)
+{
+}
+
+Ptr<Packet> PayloadStore::store(zmq::message_t &message, std::size_t offset)
+{
+    expire();
+    uint32_t length = message.size() - offset;
+    uint64_t id = m_nextId++;
+    // zero filled packets have no backing memory in ns-3
+    Ptr<Packet> packet = Create<Packet>(length);
+
+    packet->AddByteTag(VirtualPayloadTag(id, length));
+    Entry &entry = m_pending[id];
+    entry.message = std::move(message);
+    entry.offset = offset;
+    entry.received = 0;
+    m_stored.emplace_back(id, Simulator::Now());
+    return packet;
+}
+void PayloadStore::release(Ptr<const Packet> packet)
+{
+    ByteTagIterator it = packet->GetByteTagIterator();
+
+    while(it.HasNext()){
+        ByteTagIterator::Item item = it.Next();
+        VirtualPayloadTag tag;
+        if(item.GetTypeId() != VirtualPayloadTag::GetTypeId()){
+            continue;
+        }
+        item.GetTag(tag);
+        m_dropped += m_pending.erase(tag.GetId());
+    }
+}
+/* ids only grow, so the entries to age out are at the front, completed ones are skipped */
+void PayloadStore::expire(void)
+{
+    Time oldest = Simulator::Now() - m_maxAge;
+
+    while(!m_stored.empty()){
+        auto entry = m_pending.find(m_stored.front().first);
+        if(entry != m_pending.end()){
+            if(m_stored.front().second >= oldest){
+                break;
+            }
+            NS_LOG_WARN("[PayloadStore] message " << entry->first << " never completed, dropped");
+            m_pending.erase(entry);
+            m_dropped++;
+        }
+        m_stored.pop_front();
+    }
+}
+uint32_t PayloadStore::reassemble(Ptr<Packet> chunk, std::vector<zmq::message_t> &done)
+{
+    uint32_t virtualBytes = 0;
+    ByteTagIterator it = chunk->GetByteTagIterator();
+
+    while(it.HasNext()){
+        ByteTagIterator::Item item = it.Next();
+        VirtualPayloadTag tag;
+        if(item.GetTypeId() != VirtualPayloadTag::GetTypeId()){
+            continue;
+        }
+        item.GetTag(tag);
+        virtualBytes += item.GetEnd() - item.GetStart();
+
+        auto entry = m_pending.find(tag.GetId());
+        if(entry == m_pending.end()){
+            NS_LOG_WARN("[PayloadStore] no payload for message " << tag.GetId());
+            continue;
+        }
+        entry->second.received += item.GetEnd() - item.GetStart();
+        if(entry->second.received < tag.GetLength()){
+            continue;
+        }
+
+        // hand the payload over without copying it
+        Entry &e = entry->second;
+        if(e.offset == 0){
+            done.emplace_back(std::move(e.message));
+        }
+        else{
+            zmq::message_t *owner = new zmq::message_t(std::move(e.message));
+            done.emplace_back((uint8_t*)owner->data() + e.offset, owner->size() - e.offset, releaseMessage, owner);
+        }
+        m_pending.erase(entry);
+    }
+    return chunk->GetSize() - virtualBytes;
+}
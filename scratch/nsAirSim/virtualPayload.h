@@ -0,0 +1,87 @@
+#ifndef INCLUDE_VIRTUALPAYLOAD_H
+#define INCLUDE_VIRTUALPAYLOAD_H
+
+// std includes
+#include <vector>
+#include <unordered_map>
+#include <deque>
+// ns3 includes
+#include "ns3/core-module.h"
+#include "ns3/network-module.h"
+// zmq includes
+#include <zmq.hpp>
+
+using namespace std;
+using namespace ns3;
+
+#define PAYLOAD_MAX_AGE (60.0) // s a payload is kept for a message that never completes
+
+/*
+* Spans the bytes of one application message whose real content is kept in
+* a PayloadStore. Byte tags survive TCP segmentation and coalescing, so the
+* receiver can count how much of each message has arrived.
+*/
+class VirtualPayloadTag: public Tag
+{
+public:
+    VirtualPayloadTag();
+    VirtualPayloadTag(uint64_t id, uint32_t length);
+
+    /**
+    * Register this type.
+    * \return The TypeId.
+    */
+    static TypeId GetTypeId(void);
+    virtual TypeId GetInstanceTypeId(void) const;
+    virtual uint32_t GetSerializedSize(void) const;
+    virtual void Serialize(TagBuffer i) const;
+    virtual void Deserialize(TagBuffer i);
+    virtual void Print(std::ostream &os) const;
+
+    uint64_t GetId(void) const {return m_id;}
+    uint32_t GetLength(void) const {return m_length;}
+private:
+    uint64_t m_id;
+    uint32_t m_length;
+};
+
+/*
+* Out of band storage of application payloads while their size-only packets
+* travel through the simulated network. One store is shared by all apps.
+* Messages that will never complete are released by the apps when they know,
+* e.g. a failed Send() or an evicted datagram, and aged out otherwise, e.g.
+* data left in the buffer of a closed socket.
+*/
+class PayloadStore
+{
+public:
+    PayloadStore(Time maxAge = Seconds(PAYLOAD_MAX_AGE));
+    // packet of message.size() - offset zero bytes standing for that part of message
+    Ptr<Packet> store(zmq::message_t &message, std::size_t offset = 0);
+    // account the tagged bytes of a received chunk and move completed payloads to done
+    // returns the number of bytes in chunk that are not virtual
+    uint32_t reassemble(Ptr<Packet> chunk, std::vector<zmq::message_t> &done);
+    // drop the payloads of every message tagged in packet
+    void release(Ptr<const Packet> packet);
+
+    std::size_t size(void) const {return m_pending.size();}
+    // payloads given up on so far, released or aged out
+    uint64_t getDropped(void) const {return m_dropped;}
+private:
+    struct Entry
+    {
+        zmq::message_t message;
+        std::size_t offset;
+        uint32_t received;
+    };
+    // drop the payloads stored more than m_maxAge ago
+    void expire(void);
+
+    uint64_t m_nextId = 0;
+    std::unordered_map<uint64_t, Entry> m_pending;
+    Time m_maxAge;
+    std::deque< std::pair<uint64_t, Time> > m_stored; // id and store time, oldest first
+    uint64_t m_dropped = 0;
+};
+
+#endif
@@ -0,0 +1,222 @@
+#ifndef INCLUDE_WIREFORMAT_H
+#define INCLUDE_WIREFORMAT_H
+// Binary frames exchanged with AirSim. Kept free of ns3/AirLib includes so that
+// the AirSim side can share this header as is.
+// All fields are little endian and packed, decode with memcpy (no alignment assumed)
+
+// std includes
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+
+// frame types, first byte of every binary control frame
+#define CTRL_FRAME_POSE ('P')
+#define CTRL_FRAME_TICK ('T') // AirSim -> ns, end of AirSim's turn
+#define CTRL_FRAME_BYE ('B') // AirSim -> ns, end of the session
+#define CTRL_FRAME_GRANT ('G') // ns -> AirSim, AirSim may finish every tick up to this one
+#define CTRL_FRAME_NET_STATE ('N') // ns -> AirSim, link metrics per UAV, right before the grant
+// second byte of every typed control frame but pose frames, never part of the
+// text older AirSim builds end their turn with
+#define CTRL_FRAME_MAGIC (0xA5)
+
+// application message frames, see MsgHeader
+#define MSG_FRAME_ACK ('A')
+#define MSG_NO_VEHICLE (0xFFFF) // sender not identified yet
+
+// NetConfig sent as a msgpack map carries this as "version", bumped when a
+// field changes meaning, not when one is added, see NetConfig in AirSimSync.h
+#define NET_CONFIG_VERSION (1)
+
+// pose frame flags
+#define POSE_FLAG_DELTA (0x01) // entries are PoseDeltaEntry relative to the last frame
+#define POSE_FLAG_ACCEL (0x02) // every entry is followed by its acceleration
+
+// net state frame flags
+#define NET_STATE_FLAG_WIFI (0x01) // radio fields are RSSI and MCS, else RSRP, SINR and CQI
+
+// NetStateEntry::valid bits, a field is only meaningful once its source reported
+#define NET_STATE_VALID_RADIO (0x01)
+#define NET_STATE_VALID_CELL (0x02)
+#define NET_STATE_VALID_TCP (0x04)
+#define NET_STATE_NO_CELL (0xFFFF)
+
+// fixed point resolution of PoseDeltaEntry
+#define POSE_DELTA_POS_SCALE (100.0f) // cm
+#define POSE_DELTA_VEL_SCALE (100.0f) // cm/s
+#define POSE_DELTA_ACC_SCALE (100.0f) // cm/s^2
+
+#pragma pack(push, 1)
+/*
+* AirSim -> ns, one per tick on the control channel when usePoseStream is set
+* | PoseFrameHeader | count * (PoseEntry [PoseAccel] | PoseDeltaEntry [PoseDeltaAccel]) |
+*/
+struct PoseFrameHeader
+{
+    uint8_t type; // CTRL_FRAME_POSE
+    uint8_t flags;
+    uint16_t count;
+    uint32_t tick;
+};
+// absolute pose, vehicleId is the index into NetConfig::uavsName
+struct PoseEntry
+{
+    uint16_t vehicleId;
+    float pos[3];
+    float vel[3];
+};
+// position offset from the previous frame and velocity, both fixed point
+struct PoseDeltaEntry
+{
+    uint16_t vehicleId;
+    int16_t dpos[3];
+    int16_t vel[3];
+};
+struct PoseAccel
+{
+    float acc[3];
+};
+struct PoseDeltaAccel
+{
+    int16_t acc[3];
+};
+/*
+* Typed control frames. AirSim ends every tick with a TickFrame, or in
+* lockstep (lookahead 0) with a pose frame, and the session with a bare
+* CtrlFrameHeader of type CTRL_FRAME_BYE.
+* With a lookahead of K ticks, ns grants tick t + K when it starts tick t,
+* so AirSim can run up to K ticks ahead. Its frames then queue up in order
+* and the message counts of a TickFrame tell ns where tick t ends on the muxes.
+* Ticks may vary in length: every grant suggests a step for the granted tick
+* and AirSim answers with the step it actually ran in that tick's TickFrame.
+*/
+struct CtrlFrameHeader
+{
+    uint8_t type; // CTRL_FRAME_TICK, CTRL_FRAME_BYE or CTRL_FRAME_GRANT
+    uint8_t magic; // CTRL_FRAME_MAGIC
+    uint16_t reserved;
+    uint32_t tick;
+};
+struct TickFrame
+{
+    CtrlFrameHeader hdr;
+    uint32_t uavMsgs; // messages AirSim sent on the UAV mux during this tick
+    uint32_t gcsMsgs; // same for the GCS mux
+    float step; // seconds this tick lasted, 0 for the configured updateGranularity
+};
+struct GrantFrame
+{
+    CtrlFrameHeader hdr;
+    float step; // suggested length of the granted tick in seconds
+};
+/*
+* | NetStateHeader | count * NetStateEntry |, the state at the end of tick
+*/
+struct NetStateHeader
+{
+    uint8_t type; // CTRL_FRAME_NET_STATE
+    uint8_t magic; // CTRL_FRAME_MAGIC
+    uint16_t count;
+    uint32_t tick;
+    float simTime; // s
+    uint32_t flags;
+};
+struct NetStateEntry
+{
+    uint16_t vehicleId;
+    uint16_t valid; // NET_STATE_VALID_*
+    uint16_t cell; // LTE cell id or index of the Wifi AP, NET_STATE_NO_CELL
+    uint8_t cqi; // LTE, wideband from the SINR
+    uint8_t mcs; // Wifi, of the last frame from the AP
+    float rsrpDbm; // LTE
+    float sinrDb; // LTE
+    float rssiDbm; // Wifi, of the last frame from the AP
+    uint32_t cwnd; // bytes, UAV -> GCS connection
+    float rttMs;
+    uint32_t bytesQueued; // in the UAV's send buffer
+    uint64_t bytesUp; // delivered to the GCS app from this UAV so far
+    uint64_t bytesDown; // delivered to this UAV's app so far
+};
+/*
+* Application messages on a ZmqMux, one header frame per message
+* AirSim -> ns: | MsgHeader | payload |, acknowledged with either
+*     | MsgHeader | int32 Send() result |         one per message (default)
+*     | AckHeader | count * AckEntry |           one per drain (asyncAck)
+* ns -> AirSim: | MsgHeader | payload |
+* A message with a send offset is sent that far into the tick and acknowledged
+* right away with 0, its Send() result is only traced.
+* Messages of a UDP class may be lost, or arrive out of order with the others.
+*/
+struct MsgHeader
+{
+    uint16_t vehicleId; // index into NetConfig::uavsName, GCS peers that are not UAVs come after
+    uint32_t seq; // per sender, echoed back in the acknowledgement
+    // AirSim -> ns: intended send time as an offset from the start of the tick, 0 sends at once
+    // ns -> AirSim: simulated time the message was delivered
+    int64_t timeNs;
+    // what kind of traffic this is, classes set in NetConfig::udpClasses go over UDP, echoed on delivery
+    uint8_t msgClass;
+};
+struct AckHeader
+{
+    uint8_t type; // MSG_FRAME_ACK
+    uint8_t reserved;
+    uint16_t count;
+};
+struct AckEntry
+{
+    uint16_t vehicleId;
+    uint32_t seq;
+    int32_t result;
+};
+#pragma pack(pop)
+
+// bytes taken by one vehicle in a pose frame with the given flags
+inline std::size_t poseEntrySize(uint8_t flags)
+{
+    if(flags & POSE_FLAG_DELTA){
+        return sizeof(PoseDeltaEntry) + ((flags & POSE_FLAG_ACCEL) ? sizeof(PoseDeltaAccel) : 0);
+    }
+    return sizeof(PoseEntry) + ((flags & POSE_FLAG_ACCEL) ? sizeof(PoseAccel) : 0);
+}
+
+// true if messages of msgClass go over UDP, udpClasses has bit n set for class n
+inline bool msgClassUsesUdp(uint32_t udpClasses, uint8_t msgClass)
+{
+    return msgClass < 32 && ((udpClasses >> msgClass) & 1);
+}
+
+// size of a well formed pose frame, 0 if the buffer cannot be one
+inline std::size_t poseFrameSize(const void *data, std::size_t size)
+{
+    PoseFrameHeader hdr;
+    if(size < sizeof(hdr)){
+        return 0;
+    }
+    memcpy(&hdr, data, sizeof(hdr));
+    if(hdr.type != CTRL_FRAME_POSE){
+        return 0;
+    }
+    std::size_t total = sizeof(hdr) + hdr.count * poseEntrySize(hdr.flags);
+    return (total <= size) ? total : 0;
+}
+
+// type of a typed control frame of at least header size, 0 otherwise
+inline uint8_t ctrlFrameType(const void *data, std::size_t size)
+{
+    uint8_t type, magic;
+    if(size < sizeof(CtrlFrameHeader)){
+        return 0;
+    }
+    memcpy(&type, data, sizeof(type));
+    memcpy(&magic, static_cast<const uint8_t*>(data) + 1, sizeof(magic));
+    if(magic != CTRL_FRAME_MAGIC){
+        return 0;
+    }
+    if((type == CTRL_FRAME_TICK && size < sizeof(TickFrame)) || (type == CTRL_FRAME_GRANT && size < sizeof(GrantFrame))
+        || (type == CTRL_FRAME_NET_STATE && size < sizeof(NetStateHeader))){
+        return 0;
+    }
+    return (type == CTRL_FRAME_TICK || type == CTRL_FRAME_BYE || type == CTRL_FRAME_GRANT || type == CTRL_FRAME_NET_STATE) ? type : 0;
+}
+
+#endif
@@ -0,0 +1,88 @@
+// std includes
+#include <vector>
+#include <thread>
+#include <mutex>
+// custom includes
+#include "workerPool.h"
+
+using namespace std;
+
+WorkerPool::WorkerPool(std::size_t workers)
+{
+    for(std::size_t i = 0; i < workers; i++){
+        m_threads.emplace_back(&WorkerPool::loop, this, i);
+    }
+}
+WorkerPool::~WorkerPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_start.notify_all();
+    for(auto &it:m_threads){
+        it.join();
+    }
+}
+
+void WorkerPool::run(const std::function<void(std::size_t)> &job)
+{
+    std::exception_ptr error;
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_job = &job;
+        m_running = m_threads.size();
+        m_error = nullptr;
+        m_batch++;
+    }
+    m_start.notify_all();
+    try{
+        job(0);
+    }
+    catch(...){
+        error = std::current_exception();
+    }
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_done.wait(lock, [this]{return m_running == 0;});
+    m_job = nullptr;
+    if(!error){
+        error = m_error;
+    }
+    lock.unlock();
+    if(error){
+        std::rethrow_exception(error);
+    }
+}
+void WorkerPool::loop(std::size_t index)
+{
+    uint64_t batch = 0;
+
+    while(true){
+        const std::function<void(std::size_t)> *job;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_start.wait(lock, [this, batch]{return m_stop || m_batch != batch;});
+            if(m_stop){
+                return;
+            }
+            batch = m_batch;
+            job = m_job;
+        }
+        std::exception_ptr error;
+        try{
+            (*job)(index + 1);
+        }
+        catch(...){
+            error = std::current_exception();
+        }
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if(error && !m_error){
+            m_error = error;
+        }
+        if(--m_running == 0){
+            m_done.notify_one();
+        }
+    }
+}
@@ -0,0 +1,45 @@
+#ifndef INCLUDE_WORKERPOOL_H
+#define INCLUDE_WORKERPOOL_H
+
+// std includes
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <exception>
+#include <cstdint>
+
+using namespace std;
+
+/*
+* Threads started once and handed one batch at a time, so a per-tick fan
+* out does not pay for thread creation. The caller takes part in every
+* batch as index 0, worker i runs index i + 1.
+*/
+class WorkerPool
+{
+public:
+    explicit WorkerPool(std::size_t workers);
+    ~WorkerPool();
+
+    // workers plus the caller
+    std::size_t size(void) const {return m_threads.size() + 1;}
+    // job(i) for every i below size(), returns once all are done and
+    // rethrows the first exception of any of them
+    void run(const std::function<void(std::size_t)> &job);
+private:
+    void loop(std::size_t index);
+
+    std::vector<std::thread> m_threads;
+    std::mutex m_mutex;
+    std::condition_variable m_start;
+    std::condition_variable m_done;
+    const std::function<void(std::size_t)> *m_job = nullptr;
+    uint64_t m_batch = 0; // bumped for every run()
+    std::size_t m_running = 0; // workers still in the current batch
+    std::exception_ptr m_error;
+    bool m_stop = false;
+};
+
+#endif
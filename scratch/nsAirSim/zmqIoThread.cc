@@ -0,0 +1,116 @@
+// std includes
+#include <string>
+#include <chrono>
+// ns3 includes
+#include "ns3/core-module.h"
+// zmq includes
+#include <zmq.hpp>
+// custom includes
+#include "zmqIoThread.h"
+
+using namespace std;
+using namespace ns3;
+
+NS_LOG_COMPONENT_DEFINE ("ZmqIoThread");
+
+#define IO_POLL_TIMEOUT_MS (10) // how long stop() may wait
+#define IO_STALL_RETRY_MS (1) // a full inbound queue is retried this often
+
+ZmqIoThread::ZmqIoThread(zmq::context_t &context, std::size_t queueCapacity):
+    m_capacity(queueCapacity), m_sleeping(false), m_stop(false)
+{
+    static int instances = 0;
+    std::string address = "inproc://zmqIoThreadWake" + to_string(instances++);
+
+    m_wakeRecv = zmq::socket_t(context, ZMQ_PAIR);
+    m_wakeRecv.bind(address);
+    m_wakeSend = zmq::socket_t(context, ZMQ_PAIR);
+    m_wakeSend.connect(address);
+}
+ZmqIoThread::~ZmqIoThread()
+{
+    stop();
+    m_wakeSend.close();
+    m_wakeRecv.close();
+}
+
+void ZmqIoThread::add(ZmqMux *mux)
+{
+    if(m_thread.joinable()){
+        NS_FATAL_ERROR("[ZmqIoThread] add a mux before start()");
+    }
+    mux->attachIoThread(this, m_capacity);
+    m_muxes.push_back(mux);
+}
+void ZmqIoThread::start(void)
+{
+    m_thread = std::thread(&ZmqIoThread::loop, this);
+}
+void ZmqIoThread::stop(void)
+{
+    if(!m_thread.joinable()){
+        return;
+    }
+    m_stop = true;
+    wake();
+    m_thread.join();
+}
+
+void ZmqIoThread::wake(void)
+{
+    if(m_sleeping.exchange(false)){
+        zmq::message_t signal;
+        m_wakeSend.send(signal, zmq::send_flags::dontwait);
+    }
+}
+
+void ZmqIoThread::loop(void)
+{
+    std::vector<zmq::pollitem_t> items;
+    std::vector<bool> stalled(m_muxes.size(), false);
+
+    while(!m_stop.load()){
+        bool pending = false;
+        bool anyStalled = false;
+
+        for(auto it:m_muxes){
+            it->ioSend();
+        }
+
+        items.assign(1, {static_cast<void*>(m_wakeRecv), 0, ZMQ_POLLIN, 0});
+        for(std::size_t i = 0; i < m_muxes.size(); i++){
+            // a stalled mux is retried on a timer, its socket stays readable
+            if(stalled[i]){
+                anyStalled = true;
+                continue;
+            }
+            items.push_back(m_muxes[i]->getPollItem());
+        }
+
+        // a send queued between ioSend() and here would not wake us up
+        m_sleeping = true;
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        for(auto it:m_muxes){
+            pending = pending || it->ioPendingSend();
+        }
+        long timeout = pending ? 0 : (anyStalled ? IO_STALL_RETRY_MS : IO_POLL_TIMEOUT_MS);
+        zmq::poll(items.data(), items.size(), std::chrono::milliseconds(timeout));
+        m_sleeping = false;
+
+        if(items[0].revents & ZMQ_POLLIN){
+            zmq::message_t signal;
+            while(m_wakeRecv.recv(signal, zmq::recv_flags::dontwait)){
+            }
+        }
+        for(std::size_t i = 0, p = 0; i < m_muxes.size(); i++){
+            bool readable = !stalled[i] && (items[1 + p++].revents & ZMQ_POLLIN);
+            if(stalled[i] || readable){
+                stalled[i] = !m_muxes[i]->ioRecv();
+            }
+        }
+    }
+    // last acks and messages for AirSim
+    for(auto it:m_muxes){
+        it->ioSend();
+    }
+}
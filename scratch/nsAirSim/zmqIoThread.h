@@ -0,0 +1,53 @@
+#ifndef INCLUDE_ZMQIOTHREAD_H
+#define INCLUDE_ZMQIOTHREAD_H
+
+// std includes
+#include <vector>
+#include <atomic>
+#include <thread>
+#include <cstdint>
+// zmq includes
+#include <zmq.hpp>
+// custom includes
+#include "zmqMux.h"
+
+using namespace std;
+
+// messages queued per mux and direction, the ring is allocated up front.
+// A full inbound queue leaves the rest in the socket and a full outbound
+// one makes the simulator wait, so this only needs to cover a usual tick
+#define IO_QUEUE_CAPACITY (4096)
+
+/*
+* Owns the sockets of every ZmqMux added to it. One background thread polls
+* them all, parses received messages into a lock-free queue per mux and
+* sends whatever the simulator thread queued back (acks and send()), so the
+* socket calls of a tick are off the simulator thread.
+*/
+class ZmqIoThread
+{
+public:
+    ZmqIoThread(zmq::context_t &context, std::size_t queueCapacity = IO_QUEUE_CAPACITY);
+    ~ZmqIoThread();
+
+    // before start()
+    void add(ZmqMux *mux);
+    void start(void);
+    // sends what is still queued, then joins
+    void stop(void);
+    // simulator thread, something was queued to send
+    void wake(void);
+private:
+    void loop(void);
+
+    std::vector<ZmqMux*> m_muxes;
+    std::size_t m_capacity;
+    // inproc pair, wakes the poll up for queued sends
+    zmq::socket_t m_wakeRecv;
+    zmq::socket_t m_wakeSend;
+    std::atomic<bool> m_sleeping; // in or about to be in zmq::poll
+    std::atomic<bool> m_stop;
+    std::thread m_thread;
+};
+
+#endif
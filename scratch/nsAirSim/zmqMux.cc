@@ -0,0 +1,313 @@
+// std includes
+#include <string>
+#include <cstring>
+#include <algorithm>
+#include <thread>
+#include <chrono>
+// ns3 includes
+#include "ns3/core-module.h"
+// zmq includes
+#include <zmq.hpp>
+// custom includes
+#include "zmqMux.h"
+#include "zmqIoThread.h"
+
+using namespace std;
+using namespace ns3;
+
+NS_LOG_COMPONENT_DEFINE ("ZmqMux");
+
+#define MUX_IO_RECV_BATCH (256) // messages read per readable socket before serving the others
+
+ZmqMux::ZmqMux(zmq::context_t &context, int zmqRecvPort, int zmqSendPort, bool asyncAck):
+    m_asyncAck(asyncAck)
+{
+    m_zmqSocketSend = zmq::socket_t(context, ZMQ_PUSH);
+    m_zmqSocketSend.bind("tcp://*:" + to_string(zmqSendPort));
+    m_zmqSocketRecv = zmq::socket_t(context, ZMQ_ROUTER);
+    m_zmqSocketRecv.connect("tcp://localhost:" + to_string(zmqRecvPort));
+}
+ZmqMux::~ZmqMux()
+{
+    m_zmqSocketSend.close();
+    m_zmqSocketRecv.close();
+}
+
+bool ZmqMux::recvParts(std::vector<zmq::message_t> &parts)
+{
+    zmq::recv_result_t res;
+    parts.clear();
+    do{
+        parts.emplace_back();
+        // the rest of a multipart message is already there once the first frame is
+        res = m_zmqSocketRecv.recv(parts.back(), zmq::recv_flags::dontwait);
+        if(!res.has_value()){
+            parts.pop_back();
+            break;
+        }
+    }while(parts.back().more());
+    return !parts.empty();
+}
+
+/* | routing id | MsgHeader | payload | */
+void ZmqMux::drain(const Handler &handler, std::size_t count)
+{
+    std::vector<zmq::message_t> parts;
+    bool block = (count != MUX_DRAIN_ALL);
+    std::size_t n = 0;
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(MUX_DRAIN_TIMEOUT_MS);
+
+    if(m_sessionLog && m_sessionLog->isReplay()){
+        // nobody to acknowledge
+        const uint8_t *data;
+        std::size_t size;
+        for(; n < count && m_sessionLog->read(LOG_MSG, m_logChannel, data, size); n++){
+            MsgHeader hdr;
+            if(size < sizeof(hdr)){
+                NS_LOG_WARN("[ZmqMux] drop a recorded message of " << size << " bytes");
+                continue;
+            }
+            memcpy(&hdr, data, sizeof(hdr));
+            zmq::message_t payload(data + sizeof(hdr), size - sizeof(hdr));
+            m_drained++;
+            handler(hdr, payload);
+        }
+        return;
+    }
+
+    if(m_io){
+        // the I/O thread already has them, or will have them shortly
+        while(n < count){
+            InboundMsg *msg = m_inbound->front();
+            if(!msg){
+                if(!block || !waitInbound(deadline)){
+                    break;
+                }
+                continue;
+            }
+            if(msg->valid){
+                handle(handler, msg->routingId, msg->head, msg->payload);
+            }
+            else{
+                NS_LOG_WARN("[ZmqMux] drop a malformed message");
+            }
+            m_inbound->pop();
+            n++;
+        }
+    }
+    else{
+        while(n < count){
+            if(!recvParts(parts)){
+                if(!block || !waitInbound(deadline)){
+                    break;
+                }
+                continue;
+            }
+            n++;
+            if(parts.size() != 3 || parts[1].size() != sizeof(MsgHeader)){
+                NS_LOG_WARN("[ZmqMux] drop a malformed message of " << parts.size() << " frames");
+                continue;
+            }
+            handle(handler, parts[0], parts[1], parts[2]);
+        }
+    }
+    if(block && n < count){
+        // a lost or late message must not hang the simulation, the late one goes to the next drain
+        NS_LOG_WARN("[ZmqMux] expected " << count << " messages, received " << n << " within " << MUX_DRAIN_TIMEOUT_MS << " ms, go on with those");
+    }
+    flushAcks();
+}
+bool ZmqMux::waitInbound(const std::chrono::steady_clock::time_point &deadline)
+{
+    auto left = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now());
+    if(left.count() <= 0){
+        return false;
+    }
+    if(m_io){
+        // the I/O thread is receiving it
+        std::unique_lock<std::mutex> lock(m_inboundMutex);
+        m_inboundReady.wait_until(lock, deadline, [this]{return m_inbound->front() != nullptr;});
+        return true;
+    }
+    zmq::pollitem_t item = getPollItem();
+    zmq::poll(&item, 1, left);
+    return true;
+}
+void ZmqMux::handle(const Handler &handler, zmq::message_t &routingId, zmq::message_t &head, zmq::message_t &payload)
+{
+    MsgHeader hdr;
+    memcpy(&hdr, head.data(), sizeof(hdr));
+    if(m_sessionLog){
+        m_sessionLog->write(LOG_MSG, m_logChannel, head.data(), head.size(), payload.data(), payload.size());
+    }
+    m_drained++;
+    int result = handler(hdr, payload);
+    if(!m_noAck){
+        ack(routingId, head, result);
+    }
+}
+Time ZmqMux::sendDelay(const MsgHeader &hdr, Time step)
+{
+    if(hdr.timeNs <= 0){
+        return Seconds(0);
+    }
+    Time delay = NanoSeconds(hdr.timeNs);
+    if(delay >= step){
+        NS_LOG_WARN("[ZmqMux] vehicle " << hdr.vehicleId << " sends " << delay.GetSeconds() << " s into a tick of " << step.GetSeconds() << " s, send at its end instead");
+        return step - NanoSeconds(1);
+    }
+    return delay;
+}
+/* | MsgHeader | payload | */
+void ZmqMux::send(uint16_t vehicleId, zmq::message_t &payload, uint8_t msgClass)
+{
+    MsgHeader hdr;
+    hdr.vehicleId = vehicleId;
+    hdr.seq = m_sendSeq++;
+    hdr.timeNs = Simulator::Now().GetNanoSeconds();
+    hdr.msgClass = msgClass;
+    zmq::message_t frames[2];
+    frames[0].rebuild(&hdr, sizeof(hdr));
+    frames[1].move(payload);
+
+    sendFrames(false, frames, 2);
+}
+void ZmqMux::sendFrames(bool toRouter, zmq::message_t *frames, std::size_t count)
+{
+    if(m_io){
+        OutboundMsg out;
+        for(std::size_t i = 0; i < count; i++){
+            out.frames[i].move(frames[i]);
+        }
+        out.count = count;
+        out.toRouter = toRouter;
+        // never drop an ack, the I/O thread empties the queue without waiting on anything
+        while(!m_outbound->push(std::move(out))){
+            std::this_thread::yield();
+        }
+        m_io->wake();
+        return;
+    }
+
+    sendNow(toRouter, frames, count);
+}
+void ZmqMux::sendNow(bool toRouter, zmq::message_t *frames, std::size_t count)
+{
+    // replies may wait for the peer, a push never blocks
+    zmq::socket_t &socket = toRouter ? m_zmqSocketRecv : m_zmqSocketSend;
+    for(std::size_t i = 0; i < count; i++){
+        bool last = (i + 1 == count);
+        zmq::send_flags flags = (last || !toRouter) ? zmq::send_flags::dontwait : zmq::send_flags::none;
+        if(!last){
+            flags = flags | zmq::send_flags::sndmore;
+        }
+        socket.send(frames[i], flags);
+    }
+}
+
+void ZmqMux::setSessionLog(SessionLog *sessionLog, uint16_t channel)
+{
+    m_sessionLog = sessionLog;
+    m_logChannel = channel;
+}
+
+void ZmqMux::ack(zmq::message_t &routingId, zmq::message_t &head, int result)
+{
+    if(!m_asyncAck){
+        // | routing id | MsgHeader | int32 |
+        zmq::message_t frames[3];
+        frames[0].move(routingId);
+        frames[1].move(head);
+        frames[2].rebuild(sizeof(result));
+        memcpy(frames[2].data(), &result, sizeof(result));
+        sendFrames(true, frames, 3);
+        return;
+    }
+
+    MsgHeader hdr;
+    AckEntry entry;
+    std::string rid(static_cast<const char*>(routingId.data()), routingId.size());
+    memcpy(&hdr, head.data(), sizeof(hdr));
+    entry.vehicleId = hdr.vehicleId;
+    entry.seq = hdr.seq;
+    entry.result = result;
+
+    for(auto &it:m_pendingAcks){
+        if(it.routingId == rid){
+            it.entries.push_back(entry);
+            return;
+        }
+    }
+    m_pendingAcks.push_back(PendingAck{rid, {entry}});
+}
+/* | routing id | AckHeader | count * AckEntry | */
+void ZmqMux::flushAcks(void)
+{
+    for(auto &it:m_pendingAcks){
+        // count is 16 bits, split very long drains
+        for(std::size_t first = 0; first < it.entries.size(); first += 0xFFFF){
+            std::size_t count = min(it.entries.size() - first, (std::size_t)0xFFFF);
+            AckHeader hdr;
+            hdr.type = MSG_FRAME_ACK;
+            hdr.reserved = 0;
+            hdr.count = count;
+
+            zmq::message_t frames[2];
+            frames[0].rebuild(it.routingId.data(), it.routingId.size());
+            frames[1].rebuild(sizeof(hdr) + count*sizeof(AckEntry));
+            memcpy(frames[1].data(), &hdr, sizeof(hdr));
+            memcpy(static_cast<uint8_t*>(frames[1].data()) + sizeof(hdr), &it.entries[first], count*sizeof(AckEntry));
+            sendFrames(true, frames, 2);
+        }
+    }
+    m_pendingAcks.clear();
+}
+
+void ZmqMux::attachIoThread(ZmqIoThread *io, std::size_t capacity)
+{
+    m_io = io;
+    m_inbound.reset(new SpscQueue<InboundMsg>(capacity));
+    m_outbound.reset(new SpscQueue<OutboundMsg>(capacity));
+}
+bool ZmqMux::ioRecv(void)
+{
+    std::vector<zmq::message_t> parts;
+    std::size_t n = 0;
+
+    for(; n < MUX_IO_RECV_BATCH; n++){
+        if(!m_stalled){
+            if(!recvParts(parts)){
+                break;
+            }
+            InboundMsg &msg = m_stalledMsg;
+            msg.valid = (parts.size() == 3 && parts[1].size() == sizeof(MsgHeader));
+            if(msg.valid){
+                msg.routingId.move(parts[0]);
+                msg.head.move(parts[1]);
+                msg.payload.move(parts[2]);
+            }
+        }
+        // the simulator is behind, leave the rest in the socket
+        m_stalled = !m_inbound->push(std::move(m_stalledMsg));
+        if(m_stalled){
+            break;
+        }
+        m_stalledMsg = InboundMsg();
+    }
+    if(n > 0){
+        // taking the lock orders the push before a drain() that is about to wait
+        {
+            std::lock_guard<std::mutex> lock(m_inboundMutex);
+        }
+        m_inboundReady.notify_one();
+    }
+    return !m_stalled;
+}
+void ZmqMux::ioSend(void)
+{
+    OutboundMsg *out;
+    while((out = m_outbound->front()) != nullptr){
+        sendNow(out->toRouter, out->frames, out->count);
+        m_outbound->pop();
+    }
+}
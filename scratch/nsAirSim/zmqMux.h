@@ -0,0 +1,132 @@
+#ifndef INCLUDE_ZMQMUX_H
+#define INCLUDE_ZMQMUX_H
+
+// std includes
+#include <vector>
+#include <string>
+#include <functional>
+#include <cstdint>
+#include <memory>
+#include <chrono>
+#include <mutex>
+#include <condition_variable>
+// ns3 includes
+#include "ns3/core-module.h"
+// zmq includes
+#include <zmq.hpp>
+// custom includes
+#include "wireFormat.h"
+#include "sessionLog.h"
+#include "spscQueue.h"
+
+using namespace std;
+using namespace ns3;
+
+#define MUX_DRAIN_ALL (SIZE_MAX) // whatever is pending, without blocking
+#define MUX_DRAIN_TIMEOUT_MS (5000) // longest wait for a counted drain before going on with what arrived
+
+class ZmqIoThread;
+
+/*
+* One endpoint pair shared by every vehicle, the vehicle is named by MsgHeader.
+* AirSim -> ns: ROUTER connected to AirSim's DEALER, | routing id | MsgHeader | payload |
+* ns -> AirSim: PUSH bound for AirSim's PULL, | MsgHeader | payload |
+* Socket work per tick is independent of the number of vehicles.
+* With asyncAck the Send() results of one drain go back as a single batched
+* AckHeader frame per peer, so AirSim can pipeline messages instead of
+* waiting on a reply each.
+* Attached to a ZmqIoThread the sockets belong to that thread: drain() pops
+* messages it already received and parsed, acks and send() are queued back
+* to it, so the simulator thread makes no socket calls.
+*/
+class ZmqMux
+{
+public:
+    // returns the Send() result replied to AirSim
+    typedef std::function<int(const MsgHeader &hdr, zmq::message_t &payload)> Handler;
+
+    ZmqMux(zmq::context_t &context, int zmqRecvPort, int zmqSendPort, bool asyncAck = false);
+    ~ZmqMux();
+
+    // hand every pending message to handler without blocking, or wait until
+    // exactly count messages were handled, at most MUX_DRAIN_TIMEOUT_MS
+    void drain(const Handler &handler, std::size_t count = MUX_DRAIN_ALL);
+    // stamped with the current simulated time as the delivery time, msgClass is the sender's
+    void send(uint16_t vehicleId, zmq::message_t &payload, uint8_t msgClass = 0);
+    // record every received message on channel, or drain from the log when replaying
+    void setSessionLog(SessionLog *sessionLog, uint16_t channel);
+    // hdr.timeNs of a received message as a delay into a tick of length step,
+    // clamped to [0, step) so a bad offset cannot push a send past the tick
+    static Time sendDelay(const MsgHeader &hdr, Time step);
+    // messages handed to a handler so far
+    uint64_t getDrained(void) const {return m_drained;}
+    // AirSim does not wait on Send() results, e.g. in realtime mode
+    void disableAcks(void) {m_noAck = true;}
+    // readable when drain() has something to do
+    zmq::pollitem_t getPollItem(void) {return {static_cast<void*>(m_zmqSocketRecv), 0, ZMQ_POLLIN, 0};}
+private:
+    friend class ZmqIoThread;
+
+    // parsed by the I/O thread
+    struct InboundMsg
+    {
+        zmq::message_t routingId;
+        zmq::message_t head;
+        zmq::message_t payload;
+        bool valid = false; // | routing id | MsgHeader | payload |
+    };
+    // | frame | ... | sent by the I/O thread
+    struct OutboundMsg
+    {
+        zmq::message_t frames[3];
+        std::size_t count = 0;
+        bool toRouter = false; // ack on the receiving socket
+    };
+
+    struct PendingAck
+    {
+        std::string routingId;
+        std::vector<AckEntry> entries;
+    };
+
+    // receive all frames of one message, false if nothing is pending
+    bool recvParts(std::vector<zmq::message_t> &parts);
+    // wait for the next message, false once deadline has passed
+    bool waitInbound(const std::chrono::steady_clock::time_point &deadline);
+    // everything drain() does with one message
+    void handle(const Handler &handler, zmq::message_t &routingId, zmq::message_t &head, zmq::message_t &payload);
+    // send on one of the sockets, or hand over to the I/O thread
+    void sendFrames(bool toRouter, zmq::message_t *frames, std::size_t count);
+    void sendNow(bool toRouter, zmq::message_t *frames, std::size_t count);
+
+    // I/O thread side, see ZmqIoThread
+    void attachIoThread(ZmqIoThread *io, std::size_t capacity);
+    // false when the inbound queue is full and the socket should not be polled
+    bool ioRecv(void);
+    void ioSend(void);
+    bool ioPendingSend(void) const {return !m_outbound->empty();}
+    void ack(zmq::message_t &routingId, zmq::message_t &head, int result);
+    void flushAcks(void);
+
+    bool m_asyncAck;
+    bool m_noAck = false;
+    SessionLog *m_sessionLog = nullptr;
+    uint16_t m_logChannel = 0;
+    uint32_t m_sendSeq = 0;
+    uint64_t m_drained = 0;
+    std::vector<PendingAck> m_pendingAcks; // one per peer, usually a single one
+    zmq::socket_t m_zmqSocketSend;
+    zmq::socket_t m_zmqSocketRecv;
+
+    ZmqIoThread *m_io = nullptr;
+    // in socket order, which is the order drain() hands them out
+    std::unique_ptr< SpscQueue<InboundMsg> > m_inbound;
+    std::unique_ptr< SpscQueue<OutboundMsg> > m_outbound;
+    bool m_stalled = false;
+    InboundMsg m_stalledMsg; // did not fit its queue yet
+    // a counted drain sleeps here until ioRecv() queued something
+    std::mutex m_inboundMutex;
+    std::condition_variable m_inboundReady;
+};
+
+#endif